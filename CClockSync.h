@@ -0,0 +1,161 @@
+//Mapping from the plugin clock to the Vizard tick, kept up to date from repeated samples.
+//
+//Each sample pairs a plugin time with the Vizard tick the script read at (nearly) the
+//same moment. Over the last SYNC_WINDOW samples the mapping
+//   vizard = intercept + rate*(plugin - reference)
+//is fitted by least squares, samples more than 3 robust standard deviations
+//(1.4826 * median absolute residual) off the line are dropped and the line refitted,
+//so a sample delayed by a slow script frame does not pull the fit. With one sample
+//the rate is 1 (the old single offset). The residuals of the kept samples say how
+//well the two clocks agree.
+//
+//Not thread safe, the owner keeps it under a lock and hands copies of mapping()
+//to the threads that convert times.
+
+#ifndef CClockSyncH
+#define CClockSyncH
+
+#include <math.h>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <algorithm>
+
+//the fitted line, cheap to copy
+struct SClockMapping {
+	double reference;             //plugin time the line is centred on
+	double intercept;             //vizard time at reference
+	double rate;                  //vizard seconds per plugin second
+
+	double map(const double& plugin) const {
+		return intercept + rate*(plugin - reference);
+	}
+};
+
+class cClockSync {
+public:
+
+	enum { SYNC_WINDOW = 240 };
+
+	cClockSync() {
+		reset(0.0);
+	}
+
+	//forget every sample, map with a plain offset
+	void reset(const double& offset) {
+		m_samples.clear();
+		m_mapping.reference = 0.0;
+		m_mapping.intercept = offset;
+		m_mapping.rate = 1.0;
+		m_rms = 0.0;
+		m_maxResidual = 0.0;
+		m_inliers = 0;
+	}
+
+	//add a sample and refit
+	void add(const double& plugin, const double& vizard) {
+		m_samples.push_back(std::make_pair(plugin, vizard));
+		while(m_samples.size() > SYNC_WINDOW) {
+			m_samples.pop_front();
+		}
+		fit();
+	}
+
+	const SClockMapping& mapping() const { return m_mapping; }
+	//what the old single offset would be at plugin time t
+	double offsetAt(const double& t) const { return m_mapping.map(t) - t; }
+	double rate() const { return m_mapping.rate; }
+	//root mean square and largest residual of the samples kept (seconds)
+	double rms() const { return m_rms; }
+	double maxResidual() const { return m_maxResidual; }
+	int count() const { return int(m_samples.size()); }
+	int inliers() const { return m_inliers; }
+
+private:
+	void fit() {
+		std::vector<bool> keep(m_samples.size(), true);
+		line(keep);
+		if(m_samples.size() < 3) {
+			residuals(keep);
+			return;
+		}
+		std::vector<double> r(m_samples.size());
+		for(size_t i = 0; i < m_samples.size(); ++i) {
+			r[i] = fabs(m_samples[i].second - m_mapping.map(m_samples[i].first));
+		}
+		std::vector<double> sorted(r);
+		std::nth_element(sorted.begin(), sorted.begin() + sorted.size()/2, sorted.end());
+		//never cut tighter than a microsecond (identical clocks give a zero median)
+		double limit = 3.0*1.4826*sorted[sorted.size()/2];
+		if(limit < 1.0e-6) {
+			limit = 1.0e-6;
+		}
+		int kept = 0;
+		for(size_t i = 0; i < m_samples.size(); ++i) {
+			keep[i] = r[i] <= limit;
+			kept += keep[i] ? 1 : 0;
+		}
+		if(kept >= 2) {
+			line(keep);
+		} else {
+			keep.assign(m_samples.size(), true);
+		}
+		residuals(keep);
+	}
+
+	//least squares over the kept samples, centred on their mean plugin time
+	void line(const std::vector<bool>& keep) {
+		double n = 0.0, mx = 0.0, my = 0.0;
+		for(size_t i = 0; i < m_samples.size(); ++i) {
+			if(keep[i]) {
+				n += 1.0;
+				mx += m_samples[i].first;
+				my += m_samples[i].second;
+			}
+		}
+		if(n == 0.0) {
+			return;
+		}
+		mx /= n;
+		my /= n;
+		double sxx = 0.0, sxy = 0.0;
+		for(size_t i = 0; i < m_samples.size(); ++i) {
+			if(keep[i]) {
+				double dx = m_samples[i].first - mx;
+				sxx += dx*dx;
+				sxy += dx*(m_samples[i].second - my);
+			}
+		}
+		m_mapping.reference = mx;
+		m_mapping.intercept = my;
+		//samples too close together in time cannot give a rate
+		m_mapping.rate = sxx > 1.0e-6 ? sxy/sxx : 1.0;
+	}
+
+	void residuals(const std::vector<bool>& keep) {
+		double sum = 0.0;
+		m_maxResidual = 0.0;
+		m_inliers = 0;
+		for(size_t i = 0; i < m_samples.size(); ++i) {
+			if(keep[i]) {
+				double r = m_samples[i].second - m_mapping.map(m_samples[i].first);
+				sum += r*r;
+				if(fabs(r) > m_maxResidual) {
+					m_maxResidual = fabs(r);
+				}
+				++m_inliers;
+			}
+		}
+		m_rms = m_inliers > 0 ? sqrt(sum/double(m_inliers)) : 0.0;
+	}
+
+	std::deque<std::pair<double, double> > m_samples;   //(plugin, vizard), oldest first
+	SClockMapping m_mapping;
+	double m_rms;
+	double m_maxResidual;
+	int m_inliers;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
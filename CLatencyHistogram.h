@@ -0,0 +1,164 @@
+//Cheap always-on latency histogram.
+//
+//Values are kept in nanoseconds in log-linear buckets: every power of two is split
+//into 4 sub-buckets, so any percentile is within 25% of the true value across the
+//whole range (1 ns to centuries) with a fixed 256 counters and no allocation.
+//record() is a handful of integer operations and plain (relaxed) stores.
+//
+//One thread records. Any thread may read percentiles (the answer is approximate
+//while recording continues) or ask for a reset, which the recording thread
+//carries out on its next record() so the counters only ever have one writer.
+
+#ifndef CLatencyHistogramH
+#define CLatencyHistogramH
+
+#include <ostream>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+class cLatencyHistogram {
+public:
+
+	enum { SUB_BITS = 2, SUB_COUNT = 1 << SUB_BITS, BUCKET_COUNT = 64*SUB_COUNT };
+
+	cLatencyHistogram() : m_total(0), m_max(0), m_resetRequested(false) {
+		for(int i = 0; i < BUCKET_COUNT; ++i) {
+			m_counts[i].store(0, boost::memory_order_relaxed);
+		}
+	}
+
+	//Recording thread only.
+	void record(const double& seconds) {
+		if(m_resetRequested.load(boost::memory_order_relaxed)) {
+			clear();
+		}
+		boost::uint64_t ns = seconds > 0.0 ? boost::uint64_t(seconds*1.0e9) : 0;
+		int b = bucketOf(ns);
+		m_counts[b].store(m_counts[b].load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+		m_total.store(m_total.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+		if(ns > m_max.load(boost::memory_order_relaxed)) {
+			m_max.store(ns, boost::memory_order_relaxed);
+		}
+	}
+
+	//Any thread: the recording thread clears the counters on its next record().
+	void requestReset() {
+		m_resetRequested.store(true, boost::memory_order_relaxed);
+	}
+
+	boost::uint32_t count() const {
+		return m_total.load(boost::memory_order_relaxed);
+	}
+
+	//largest value recorded (seconds)
+	double maximum() const {
+		return 1.0e-9*double(m_max.load(boost::memory_order_relaxed));
+	}
+
+	//value (seconds) below which the fraction p of the samples fall, middle of its bucket
+	double percentile(const double& p) const {
+		boost::uint64_t total = 0;
+		for(int i = 0; i < BUCKET_COUNT; ++i) {
+			total += m_counts[i].load(boost::memory_order_relaxed);
+		}
+		if(total == 0) {
+			return 0.0;
+		}
+		boost::uint64_t target = boost::uint64_t(p*double(total) + 0.5);
+		if(target < 1) {
+			target = 1;
+		}
+		boost::uint64_t seen = 0;
+		for(int i = 0; i < BUCKET_COUNT; ++i) {
+			seen += m_counts[i].load(boost::memory_order_relaxed);
+			if(seen >= target) {
+				//the top bucket can reach past the largest value seen
+				double mid = 0.5*double(lowerBound(i) + upperBound(i));
+				double top = double(m_max.load(boost::memory_order_relaxed));
+				return 1.0e-9*(mid < top ? mid : top);
+			}
+		}
+		return maximum();
+	}
+
+	//one line per non-empty bucket: lower_ns upper_ns count
+	void write(std::ostream& out) const {
+		for(int i = 0; i < BUCKET_COUNT; ++i) {
+			boost::uint32_t c = m_counts[i].load(boost::memory_order_relaxed);
+			if(c > 0) {
+				out << lowerBound(i) << " " << upperBound(i) << " " << c << "\n";
+			}
+		}
+	}
+
+private:
+	//not copyable
+	cLatencyHistogram(const cLatencyHistogram&);
+	cLatencyHistogram& operator=(const cLatencyHistogram&);
+
+	void clear() {
+		for(int i = 0; i < BUCKET_COUNT; ++i) {
+			m_counts[i].store(0, boost::memory_order_relaxed);
+		}
+		m_total.store(0, boost::memory_order_relaxed);
+		m_max.store(0, boost::memory_order_relaxed);
+		m_resetRequested.store(false, boost::memory_order_relaxed);
+	}
+
+	static int highestBit(const boost::uint64_t& v) {
+#if defined(_MSC_VER) && defined(_M_X64)
+		unsigned long index;
+		_BitScanReverse64(&index, v);
+		return int(index);
+#elif defined(__GNUC__)
+		return 63 - __builtin_clzll(v);
+#else
+		int bit = 0;
+		boost::uint64_t x = v;
+		while(x >>= 1) {
+			++bit;
+		}
+		return bit;
+#endif
+	}
+
+	//values below SUB_COUNT get their own bucket, above that 4 per power of two
+	static int bucketOf(const boost::uint64_t& ns) {
+		if(ns < SUB_COUNT) {
+			return int(ns);
+		}
+		int e = highestBit(ns);
+		int sub = int((ns >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+		return (e - SUB_BITS + 1)*SUB_COUNT + sub;
+	}
+
+	static boost::uint64_t lowerBound(const int& b) {
+		if(b < SUB_COUNT) {
+			return boost::uint64_t(b);
+		}
+		int e = b/SUB_COUNT + SUB_BITS - 1;
+		int sub = b % SUB_COUNT;
+		return boost::uint64_t(SUB_COUNT + sub) << (e - SUB_BITS);
+	}
+
+	static boost::uint64_t upperBound(const int& b) {
+		if(b < SUB_COUNT) {
+			return boost::uint64_t(b) + 1;
+		}
+		int e = b/SUB_COUNT + SUB_BITS - 1;
+		return lowerBound(b) + (boost::uint64_t(1) << (e - SUB_BITS));
+	}
+
+	boost::atomic<boost::uint32_t> m_counts[BUCKET_COUNT];
+	boost::atomic<boost::uint32_t> m_total;
+	boost::atomic<boost::uint64_t> m_max;
+	boost::atomic<bool> m_resetRequested;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,139 @@
+//Fills in a sensor's markers that OWL lost (cond <= 0.1) for the frame, so poses built
+//from the markers keep moving through short occlusions instead of freezing and jumping.
+//
+//   three or more markers seen   the missing ones are placed from the sensor's geometry:
+//                                the rigid fit (cRigidSolver) of the geometry to the
+//                                markers seen, applied to the geometry of the missing ones
+//   fewer                        each missing marker carries on at its last velocity, for
+//                                at most the extrapolation limit after it was last seen
+//The geometry is the sensor's rigid definition when it has one, otherwise it is learned:
+//the last frame in which every marker was seen.
+//
+//fill() reports what it did so recordings can flag the samples (RECORD_FLAG_*).
+
+#ifndef CMarkerGapFillH
+#define CMarkerGapFillH
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "CRigidSolver.h"
+#include "CRecording.h"
+
+const float GAP_FILL_WEIGHT = 0.5f;        //weight (cond) given to a filled marker
+
+class cMarkerGapFiller {
+public:
+
+	cMarkerGapFiller() : m_count(0), m_fixed(false), m_learned(false), m_limit(0.1) {}
+
+	//count markers, geometry (3 floats per marker) or NULL to learn it, limit in seconds.
+	//Starts over only if something changed.
+	void configure(const int& count, const float* geometry, const double& limit) {
+		bool fixed = geometry != NULL;
+		if(count > 0 && count == m_count && fixed == m_fixed && limit == m_limit
+			&& (!fixed || memcmp(geometry, &m_geometry[0], 3*count*sizeof(float)) == 0)) {
+			return;
+		}
+		m_count = count;
+		m_fixed = fixed;
+		m_limit = limit;
+		m_learned = false;
+		m_geometry.assign(3*count, 0.0f);
+		if(fixed) {
+			memcpy(&m_geometry[0], geometry, 3*count*sizeof(float));
+			m_fit.setTemplate(geometry, count);
+		}
+		m_last.assign(3*count, 0.0f);
+		m_velocity.assign(3*count, 0.0f);
+		m_seen.assign(count, -1.0);
+	}
+
+	//Fill the markers with weight 0 (observed 3 floats each) at time t (seconds), filled
+	//ones get GAP_FILL_WEIGHT. Returns RECORD_FLAG_FILLED and/or RECORD_FLAG_EXTRAPOLATED.
+	unsigned int fill(float* observed, float* weights, const double& t) {
+		int seen = 0;
+		for(int i = 0; i < m_count; ++i) {
+			if(weights[i] <= 0.0f) {
+				continue;
+			}
+			++seen;
+			double dt = t - m_seen[i];
+			for(int k = 0; k < 3; ++k) {
+				float p = observed[3*i + k];
+				//velocity only from a recent, earlier sample
+				m_velocity[3*i + k] = m_seen[i] >= 0.0 && dt > 0.0 && dt <= m_limit
+					? float((p - m_last[3*i + k])/dt) : 0.0f;
+				m_last[3*i + k] = p;
+			}
+			m_seen[i] = t;
+		}
+		if(seen == m_count) {
+			if(!m_fixed) {
+				memcpy(&m_geometry[0], observed, 3*m_count*sizeof(float));
+				m_fit.setTemplate(observed, m_count);
+				m_learned = true;
+			}
+			return 0;
+		}
+
+		unsigned int flags = 0;
+		if(seen >= 3 && (m_fixed || m_learned)) {
+			float pose[7], rms;
+			if(m_fit.solve(observed, weights, pose, rms)) {
+				double r[3][3];
+				rotation(pose + 3, r);
+				for(int i = 0; i < m_count; ++i) {
+					if(weights[i] > 0.0f) {
+						continue;
+					}
+					const float* g = &m_geometry[3*i];
+					for(int k = 0; k < 3; ++k) {
+						observed[3*i + k] = float(pose[k] + r[k][0]*g[0] + r[k][1]*g[1] + r[k][2]*g[2]);
+					}
+					weights[i] = GAP_FILL_WEIGHT;
+				}
+				return RECORD_FLAG_FILLED;
+			}
+		}
+		for(int i = 0; i < m_count; ++i) {
+			if(weights[i] > 0.0f || m_seen[i] < 0.0) {
+				continue;
+			}
+			double dt = t - m_seen[i];
+			if(dt < 0.0 || dt > m_limit) {
+				continue;
+			}
+			for(int k = 0; k < 3; ++k) {
+				observed[3*i + k] = float(m_last[3*i + k] + m_velocity[3*i + k]*dt);
+			}
+			weights[i] = GAP_FILL_WEIGHT;
+			flags = RECORD_FLAG_FILLED | RECORD_FLAG_EXTRAPOLATED;
+		}
+		return flags;
+	}
+
+private:
+	//rotation matrix of (qw, qx, qy, qz)
+	static void rotation(const float q[4], double r[3][3]) {
+		double w = q[0], x = q[1], y = q[2], z = q[3];
+		r[0][0] = 1.0 - 2.0*(y*y + z*z); r[0][1] = 2.0*(x*y - w*z);       r[0][2] = 2.0*(x*z + w*y);
+		r[1][0] = 2.0*(x*y + w*z);       r[1][1] = 1.0 - 2.0*(x*x + z*z); r[1][2] = 2.0*(y*z - w*x);
+		r[2][0] = 2.0*(x*z - w*y);       r[2][1] = 2.0*(y*z + w*x);       r[2][2] = 1.0 - 2.0*(x*x + y*y);
+	}
+
+	int m_count;
+	bool m_fixed;                     //geometry is the rigid definition
+	bool m_learned;                   //a frame with every marker has been seen
+	double m_limit;                   //longest extrapolation (s)
+	std::vector<float> m_geometry;    //3 per marker
+	cRigidSolver m_fit;               //geometry -> this frame
+	std::vector<float> m_last;        //last seen position, 3 per marker
+	std::vector<float> m_velocity;    //3 per marker
+	std::vector<double> m_seen;       //time last seen (< 0 never)
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
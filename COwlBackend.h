@@ -0,0 +1,108 @@
+//Where the plugin gets its OWL data from.
+//
+//main.cpp talks to PhaseSpace only through a cOwlBackend, which has one method per
+//owl* call the plugin makes (same arguments, same return values). Three sources:
+//   cLiveOwlBackend       the real server through the OWL library (this file)
+//   cSyntheticOwlBackend  generated markers and rigids, no hardware (COwlSynthetic.h)
+//   cReplayOwlBackend     plays back binary recordings (COwlReplay.h)
+//
+//The backend is picked from the server address (command 9):
+//   192.168.1.220                          live
+//   sim:markers=64,rigids=4,hz=960         synthetic (options in COwlSynthetic.h)
+//   replay:file=a.psr,file=b.psr,speed=max replay (options in COwlReplay.h)
+//
+//owl.h is still needed for the OWLMarker/OWLRigid layouts and the OWL_ constants.
+//Define OWL_BACKEND_NO_LIVE to build without linking the OWL library (only sim: and
+//replay: then work), e.g. for load testing on a machine with no tracking hardware.
+
+#ifndef COwlBackendH
+#define COwlBackendH
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "owl.h"
+
+class cOwlBackend {
+public:
+	virtual ~cOwlBackend() {}
+
+	virtual int init(const char* server, const int& flags) = 0;
+	virtual void done() = 0;
+	virtual int getStatus() = 0;
+	virtual void setFloat(const int& pname, const float& value) = 0;
+	virtual void setInteger(const int& pname, const int& value) = 0;
+	virtual void trackeri(const int& tracker, const int& pname, const int& param) = 0;
+	virtual void tracker(const int& tracker, const int& pname) = 0;
+	virtual void markeri(const int& marker, const int& pname, const int& param) = 0;
+	virtual void markerfv(const int& marker, const int& pname, const float* param) = 0;
+	virtual int getMarkers(OWLMarker* markers, const unsigned int& count) = 0;
+	virtual int getRigids(OWLRigid* rigids, const unsigned int& count) = 0;
+	virtual int getString(const int& pname, char* buffer) = 0;
+};
+
+#if !defined(OWL_BACKEND_NO_LIVE)
+//straight through to the OWL library
+class cLiveOwlBackend : public cOwlBackend {
+public:
+	int init(const char* server, const int& flags) { return owlInit(server, flags); }
+	void done() { owlDone(); }
+	int getStatus() { return owlGetStatus(); }
+	void setFloat(const int& pname, const float& value) { owlSetFloat(pname, value); }
+	void setInteger(const int& pname, const int& value) { owlSetInteger(pname, value); }
+	void trackeri(const int& tracker, const int& pname, const int& param) { owlTrackeri(tracker, pname, param); }
+	void tracker(const int& tracker, const int& pname) { owlTracker(tracker, pname); }
+	void markeri(const int& marker, const int& pname, const int& param) { owlMarkeri(marker, pname, param); }
+	void markerfv(const int& marker, const int& pname, const float* param) { owlMarkerfv(marker, pname, param); }
+	int getMarkers(OWLMarker* markers, const unsigned int& count) { return owlGetMarkers(markers, count); }
+	int getRigids(OWLRigid* rigids, const unsigned int& count) { return owlGetRigids(rigids, count); }
+	int getString(const int& pname, char* buffer) { return owlGetString(pname, buffer); }
+};
+#endif
+
+//key=value pairs separated by commas, a key without a value gets "1"
+typedef std::vector<std::pair<std::string, std::string> > tOwlBackendOptions;
+
+inline tOwlBackendOptions ParseOwlBackendOptions(const std::string& text) {
+	tOwlBackendOptions options;
+	size_t start = 0;
+	while(start <= text.size()) {
+		size_t end = text.find(',', start);
+		if(end == std::string::npos) {
+			end = text.size();
+		}
+		std::string item = text.substr(start, end - start);
+		if(!item.empty()) {
+			size_t eq = item.find('=');
+			if(eq == std::string::npos) {
+				options.push_back(std::make_pair(item, std::string("1")));
+			} else {
+				options.push_back(std::make_pair(item.substr(0, eq), item.substr(eq + 1)));
+			}
+		}
+		start = end + 1;
+	}
+	return options;
+}
+
+//last value given for key, or fallback
+inline double OwlBackendOption(const tOwlBackendOptions& options, const char* key, const double& fallback) {
+	double value = fallback;
+	for(size_t i = 0; i < options.size(); ++i) {
+		if(options[i].first == key) {
+			value = atof(options[i].second.c_str());
+		}
+	}
+	return value;
+}
+
+//The comm data packet as main.cpp reads it (owlGetString(OWL_COMMDATA)):
+//8 bytes of system id, a count byte, then the ttl bits, lowest first.
+const int OWL_COMMDATA_TTL_BYTE = 9;
+const int OWL_COMMDATA_SIZE = 16;
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
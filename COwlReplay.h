@@ -0,0 +1,310 @@
+//Replays binary recordings (command 102 dumps or command 105 streams) as an OWL source.
+//
+//Server address "replay:" followed by comma separated options:
+//   file=NAME      a recording to play, repeat for several sensors (at least one)
+//   speed=F        1 plays in real time, 2 twice as fast, ... speed=max (or 0) hands
+//                  out the next frame on every poll of the read thread (default 1)
+//   loop           start over at the end instead of going quiet
+//
+//Each file drives what its sensor saw when it was recorded:
+//   point sensor   marker markers[0] of the file header
+//   rigid sensor   the rigids in order of the files' sensor ids (the order they were
+//                  created, as the plugin numbers them), and its markers placed from
+//                  the rigid definition so a rigid can be set up again from the replay
+//Recordings are stored in Vizard coordinates, they are mapped back to OWL with the
+//scale and offset in the header (a per-sensor calibration, command 20, is not undone).
+//Every sample is treated as a good one (the recordings do not keep cond).
+//
+//Frames are the union of the files' sample times. getMarkers() and getRigids() see
+//each frame once, the next frame is taken when the caller comes back for more.
+//Rigid set up reads markers only (and first empties the stream), so until the read
+//thread starts polling rigids playback is in real time even at speed=max.
+
+#ifndef COwlReplayH
+#define COwlReplayH
+
+#include <iostream>
+#include <string.h>
+
+#include "COwlBackend.h"
+#include "CPrecisionClock.h"
+#include "CRecordingReader.h"
+
+class cReplayOwlBackend : public cOwlBackend {
+public:
+
+	explicit cReplayOwlBackend(const tOwlBackendOptions& options) :
+		m_speed(OwlBackendOption(options, "speed", 1.0)),
+		m_loop(OwlBackendOption(options, "loop", 0.0) != 0.0),
+		m_start(0.0), m_firstTime(0.0), m_frame(-1), m_markerFrame(-1), m_rigidFrame(-1), m_polling(false), m_status(0) {
+		for(size_t i = 0; i < options.size(); ++i) {
+			if(options[i].first == "file") {
+				m_names.push_back(options[i].second);
+			}
+		}
+	}
+
+	~cReplayOwlBackend() {
+		done();
+	}
+
+	int init(const char* server, const int& flags) {
+		done();
+		for(size_t i = 0; i < m_names.size(); ++i) {
+			cRecordingReader* r = new cRecordingReader();
+			if(!r->open(m_names[i].c_str())) {
+				std::cout << "Error: could not open recording " << m_names[i] << " for replay\n" << std::flush;
+				delete r;
+				done();
+				return 0;
+			}
+			m_readers.push_back(r);
+			//rigids are numbered in order of sensor id
+			if(r->header().isRigid) {
+				size_t at = m_rigids.size();
+				while(at > 0 && m_readers[m_rigids[at-1]]->header().sensorId > r->header().sensorId) {
+					--at;
+				}
+				m_rigids.insert(m_rigids.begin() + at, m_readers.size() - 1);
+			}
+		}
+		if(m_readers.empty()) {
+			std::cout << "Error: no recordings given for replay (replay:file=NAME,...)\n" << std::flush;
+			return 0;
+		}
+		m_cursor.assign(m_readers.size(), 0);
+		m_current.assign(m_readers.size(), -1);
+		m_fresh.assign(m_readers.size(), false);
+		rewind();
+		m_status = 1;
+		return 1;
+	}
+
+	void done() {
+		for(size_t i = 0; i < m_readers.size(); ++i) {
+			delete m_readers[i];
+		}
+		m_readers.clear();
+		m_rigids.clear();
+		m_status = 0;
+	}
+
+	int getStatus() { return m_status; }
+	void setFloat(const int& pname, const float& value) {}
+	void setInteger(const int& pname, const int& value) {}
+	void trackeri(const int& tracker, const int& pname, const int& param) {}
+	void tracker(const int& tracker, const int& pname) {}
+	void markeri(const int& marker, const int& pname, const int& param) {}
+	void markerfv(const int& marker, const int& pname, const float* param) {}
+
+	int getMarkers(OWLMarker* markers, const unsigned int& count) {
+		if(m_markerFrame == m_frame && !step()) {
+			return 0;
+		}
+		m_markerFrame = m_frame;
+		for(unsigned int i = 0; i < count; ++i) {
+			memset(&markers[i], 0, sizeof(OWLMarker));
+			markers[i].id = int(i);
+			markers[i].frame = int(m_frame);
+			markers[i].cond = -1.0f;
+		}
+		for(size_t f = 0; f < m_readers.size(); ++f) {
+			if(m_current[f] < 0) {
+				continue;
+			}
+			const SRecordFileHeader& h = m_readers[f]->header();
+			const boost::int32_t* ids = m_readers[f]->markers();
+			float pose[7];
+			owlPose(f, pose);
+			if(!h.isRigid) {
+				if(h.markerCount > 0 && ids[0] >= 0 && (unsigned int)ids[0] < count) {
+					setMarker(markers[ids[0]], pose, m_fresh[f]);
+				}
+				continue;
+			}
+			const float* definition = m_readers[f]->rigidDefinition();
+			if(definition == NULL) {
+				continue;
+			}
+			for(int k = 0; k < h.markerCount; ++k) {
+				if(ids[k] < 0 || (unsigned int)ids[k] >= count) {
+					continue;
+				}
+				float p[3];
+				rotate(pose + 3, definition + 3*k, p);
+				p[0] += pose[0]; p[1] += pose[1]; p[2] += pose[2];
+				setMarker(markers[ids[k]], p, m_fresh[f]);
+			}
+		}
+		return int(count);
+	}
+
+	int getRigids(OWLRigid* rigids, const unsigned int& count) {
+		m_polling = true;
+		if(m_rigidFrame == m_frame && !step()) {
+			return 0;
+		}
+		m_rigidFrame = m_frame;
+		for(unsigned int i = 0; i < count; ++i) {
+			memset(&rigids[i], 0, sizeof(OWLRigid));
+			rigids[i].id = int(i);
+			rigids[i].frame = int(m_frame);
+			rigids[i].pose[3] = 1.0f;
+			rigids[i].cond = -1.0f;
+		}
+		for(size_t i = 0; i < m_rigids.size() && i < count; ++i) {
+			if(m_current[m_rigids[i]] >= 0) {
+				owlPose(m_rigids[i], rigids[i].pose);
+				rigids[i].cond = m_fresh[m_rigids[i]] ? 1.0f : -1.0f;
+			}
+		}
+		return int(count);
+	}
+
+	int getString(const int& pname, char* buffer) {
+		memset(buffer, 0, OWL_COMMDATA_SIZE);
+		if(pname != OWL_COMMDATA) {
+			return 0;
+		}
+		for(size_t f = 0; f < m_readers.size(); ++f) {
+			if(m_current[f] >= 0) {
+				buffer[OWL_COMMDATA_TTL_BYTE] = (char)(m_readers[f]->samples()[size_t(m_current[f])].ttl & 0x0f);
+				break;
+			}
+		}
+		return OWL_COMMDATA_SIZE;
+	}
+
+private:
+	//not copyable (owns the readers)
+	cReplayOwlBackend(const cReplayOwlBackend&);
+	cReplayOwlBackend& operator=(const cReplayOwlBackend&);
+
+	//back to the start, returns false if there is nothing to play
+	bool rewind() {
+		m_firstTime = 0.0;
+		bool any = false;
+		for(size_t f = 0; f < m_readers.size(); ++f) {
+			m_cursor[f] = 0;
+			m_current[f] = -1;
+			SRecordSpan s = m_readers[f]->samples();
+			if(!s.empty() && (!any || s[0].time < m_firstTime)) {
+				m_firstTime = s[0].time;
+				any = true;
+			}
+		}
+		m_start = m_clock.getCPUTimeSeconds();
+		return any;
+	}
+
+	//Take the next frame if it is due. Returns false if there is none (yet).
+	bool step() {
+		if(m_readers.empty()) {
+			return false;
+		}
+		double next = 0.0;
+		double tolerance = 0.0;
+		bool any = false;
+		for(size_t f = 0; f < m_readers.size(); ++f) {
+			SRecordSpan s = m_readers[f]->samples();
+			if(m_cursor[f] < s.size() && (!any || s[m_cursor[f]].time < next)) {
+				next = s[m_cursor[f]].time;
+				any = true;
+			}
+			//samples of one OWL frame carry slightly different times (taken per sensor),
+			//anything within half a frame of the next sample belongs to its frame
+			float frequency = m_readers[f]->header().frequency;
+			if(frequency > 0.0f && (tolerance == 0.0 || 0.5/frequency < tolerance)) {
+				tolerance = 0.5/frequency;
+			}
+		}
+		if(!any) {
+			if(!m_loop || !rewind()) {
+				return false;
+			}
+			return step();
+		}
+		//real time takes everything due (skipping frames if the caller is slow),
+		//max speed takes one frame per call
+		double until = next + tolerance;
+		if(m_speed > 0.0 || !m_polling) {
+			double speed = m_speed > 0.0 ? m_speed : 1.0;
+			double now = m_firstTime + (m_clock.getCPUTimeSeconds() - m_start)*speed;
+			if(next > now) {
+				return false;
+			}
+			if(now > until) {
+				until = now;
+			}
+		}
+		for(size_t f = 0; f < m_readers.size(); ++f) {
+			SRecordSpan s = m_readers[f]->samples();
+			m_fresh[f] = false;
+			while(m_cursor[f] < s.size() && s[m_cursor[f]].time <= until) {
+				m_current[f] = long(m_cursor[f]);
+				m_fresh[f] = true;
+				++m_cursor[f];
+			}
+		}
+		++m_frame;
+		return true;
+	}
+
+	//current sample of file f back in OWL coordinates (OWLRigid::pose layout)
+	void owlPose(const size_t& f, float pose[7]) const {
+		const SRecordFileHeader& h = m_readers[f]->header();
+		const SRecordSample& r = m_readers[f]->samples()[size_t(m_current[f])];
+		pose[0] = -r.x/h.scale[0] - h.offset[0];
+		pose[1] = r.y/h.scale[1] - h.offset[1];
+		pose[2] = r.z/h.scale[2] - h.offset[2];
+		if(h.isRigid) {
+			//stored in Vizard order, undo the x mirror
+			pose[3] = -r.qw;
+			pose[4] = -r.qx;
+			pose[5] = r.qy;
+			pose[6] = r.qz;
+		} else {
+			pose[3] = 1.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 0.0f;
+		}
+	}
+
+	//a file without a sample in this frame repeats its last one as not seen
+	static void setMarker(OWLMarker& m, const float p[3], const bool& seen) {
+		m.x = p[0];
+		m.y = p[1];
+		m.z = p[2];
+		m.cond = seen ? 1.0f : -1.0f;
+	}
+
+	//out = q v q* for q = (w, x, y, z)
+	static void rotate(const float q[4], const float v[3], float out[3]) {
+		float w = q[0], x = q[1], y = q[2], z = q[3];
+		float tx = 2.0f*(y*v[2] - z*v[1]);
+		float ty = 2.0f*(z*v[0] - x*v[2]);
+		float tz = 2.0f*(x*v[1] - y*v[0]);
+		out[0] = v[0] + w*tx + (y*tz - z*ty);
+		out[1] = v[1] + w*ty + (z*tx - x*tz);
+		out[2] = v[2] + w*tz + (x*ty - y*tx);
+	}
+
+	std::vector<std::string> m_names;
+	std::vector<cRecordingReader*> m_readers;   //in the order given
+	std::vector<size_t> m_rigids;               //rigid files (index in m_readers) in sensor id order
+	std::vector<size_t> m_cursor;               //next sample of each file
+	std::vector<long> m_current;                //sample of the current frame (-1 before the first)
+	std::vector<bool> m_fresh;                  //file has a sample in the current frame
+	cPrecisionClock m_clock;
+	double m_speed;                             //<= 0 for as fast as polled
+	bool m_loop;
+	double m_start;                             //clock time playback (re)started
+	double m_firstTime;                         //earliest sample time in the files
+	long m_frame;                               //frames taken so far - 1
+	long m_markerFrame;                         //last frame handed out by getMarkers
+	long m_rigidFrame;                          //last frame handed out by getRigids
+	bool m_polling;                             //the read thread has started (first getRigids)
+	int m_status;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
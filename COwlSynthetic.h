@@ -0,0 +1,171 @@
+//Synthetic OWL source for running the plugin without tracking hardware.
+//
+//Server address "sim:" followed by comma separated options (all optional):
+//   markers=N        markers that are ever seen, the rest report cond -1 (default all asked for)
+//   rigids=N         rigids that are ever seen (default all asked for)
+//   hz=F             frame rate, at most OWL_MAX_FREQUENCY (default the OWL_FREQUENCY set, or the max)
+//   occlude=K        every marker/rigid drops out once every K frames, staggered (default 0, never)
+//   occlude_len=L    frames each drop out lasts (default 1)
+//   ttl=P            ttl bit 0 is high for the first half of every P frames, bit b every P<<b (default 0, off)
+//   ramp=1           every coordinate of every marker and rigid is the frame number instead,
+//                    so a pose put together from two frames shows (stress tests, tests/)
+//
+//Markers circle slowly around their own rest points (so rigid definitions made from
+//them are stable) and rigids turn about y while circling. Everything is a function
+//of the frame number, so two runs give the same samples. Frames are paced by the
+//clock like a real server: a poll between frames returns 0, and if polls fall
+//behind the missed frames are skipped.
+
+#ifndef COwlSyntheticH
+#define COwlSyntheticH
+
+#include <math.h>
+#include <string.h>
+
+#include "COwlBackend.h"
+#include "CPrecisionClock.h"
+
+class cSyntheticOwlBackend : public cOwlBackend {
+public:
+
+	explicit cSyntheticOwlBackend(const tOwlBackendOptions& options) :
+		m_frequency(float(OwlBackendOption(options, "hz", 0.0))),
+		m_markerLimit(int(OwlBackendOption(options, "markers", -1.0))),
+		m_rigidLimit(int(OwlBackendOption(options, "rigids", -1.0))),
+		m_occludePeriod(int(OwlBackendOption(options, "occlude", 0.0))),
+		m_occludeLength(int(OwlBackendOption(options, "occlude_len", 1.0))),
+		m_ttlPeriod(int(OwlBackendOption(options, "ttl", 0.0))),
+		m_ramp(OwlBackendOption(options, "ramp", 0.0) > 0.5),
+		m_start(0.0), m_markerFrame(-1), m_rigidFrame(-1), m_status(1) {
+		if(m_frequency > OWL_MAX_FREQUENCY) {
+			m_frequency = OWL_MAX_FREQUENCY;
+		}
+	}
+
+	int init(const char* server, const int& flags) {
+		if(m_frequency <= 0.0f) {
+			m_frequency = OWL_MAX_FREQUENCY;
+		}
+		m_start = m_clock.getCPUTimeSeconds();
+		m_status = 1;
+		return 1;
+	}
+	void done() {}
+	int getStatus() { return m_status; }
+	void setFloat(const int& pname, const float& value) {
+		if(pname == OWL_FREQUENCY && value > 0.0f && value <= OWL_MAX_FREQUENCY) {
+			m_frequency = value;
+		}
+	}
+	void setInteger(const int& pname, const int& value) {}
+	void trackeri(const int& tracker, const int& pname, const int& param) {}
+	void tracker(const int& tracker, const int& pname) {}
+	void markeri(const int& marker, const int& pname, const int& param) {}
+	void markerfv(const int& marker, const int& pname, const float* param) {}
+
+	int getMarkers(OWLMarker* markers, const unsigned int& count) {
+		long frame = currentFrame();
+		if(frame == m_markerFrame) {
+			return 0;
+		}
+		m_markerFrame = frame;
+		double t = double(frame)/double(m_frequency);
+		for(unsigned int i = 0; i < count; ++i) {
+			double phase = 0.37*double(i);
+			markers[i].id = int(i);
+			markers[i].frame = int(frame);
+			markers[i].x = float(100.0*double(i % 8) + 20.0*cos(t + phase));
+			markers[i].y = float(1000.0 + 100.0*double(i/8 % 8) + 20.0*sin(t + phase));
+			markers[i].z = float(100.0*double(i/64) + 10.0*sin(0.5*t + phase));
+			markers[i].cond = visible(frame, int(i), m_markerLimit, 7) ? 1.0f : -1.0f;
+			markers[i].flag = 0;
+			if(m_ramp) {
+				markers[i].x = markers[i].y = markers[i].z = float(frame);
+			}
+		}
+		return int(count);
+	}
+
+	int getRigids(OWLRigid* rigids, const unsigned int& count) {
+		//the frame the markers came from, so a poll never splits one frame in two
+		long frame = m_markerFrame >= 0 ? m_markerFrame : currentFrame();
+		if(frame == m_rigidFrame) {
+			return 0;
+		}
+		m_rigidFrame = frame;
+		double t = double(frame)/double(m_frequency);
+		for(unsigned int i = 0; i < count; ++i) {
+			double phase = 0.61*double(i);
+			double half = 0.5*(0.8*t + phase);
+			rigids[i].id = int(i);
+			rigids[i].frame = int(frame);
+			rigids[i].pose[0] = float(500.0*cos(0.5*t + phase));
+			rigids[i].pose[1] = float(1200.0 + 50.0*double(i));
+			rigids[i].pose[2] = float(500.0*sin(0.5*t + phase));
+			rigids[i].pose[3] = float(cos(half));
+			rigids[i].pose[4] = 0.0f;
+			rigids[i].pose[5] = float(sin(half));
+			rigids[i].pose[6] = 0.0f;
+			rigids[i].cond = visible(frame, int(i), m_rigidLimit, 13) ? 1.0f : -1.0f;
+			rigids[i].flag = 0;
+			if(m_ramp) {
+				for(int k = 0; k < 7; ++k) {
+					rigids[i].pose[k] = float(frame);
+				}
+			}
+		}
+		return int(count);
+	}
+
+	int getString(const int& pname, char* buffer) {
+		memset(buffer, 0, OWL_COMMDATA_SIZE);
+		if(pname != OWL_COMMDATA) {
+			return 0;
+		}
+		long frame = m_markerFrame > m_rigidFrame ? m_markerFrame : m_rigidFrame;
+		if(m_ttlPeriod > 0 && frame >= 0) {
+			unsigned char bits = 0;
+			for(int b = 0; b < 4; ++b) {
+				long period = long(m_ttlPeriod) << b;
+				if(frame % period < period/2) {
+					bits |= (unsigned char)(1 << b);
+				}
+			}
+			buffer[OWL_COMMDATA_TTL_BYTE] = (char)bits;
+		}
+		return OWL_COMMDATA_SIZE;
+	}
+
+private:
+	long currentFrame() {
+		return long((m_clock.getCPUTimeSeconds() - m_start)*double(m_frequency));
+	}
+
+	//limit < 0 means every index is tracked, stagger spreads the drop outs
+	bool visible(const long& frame, const int& index, const int& limit, const int& stagger) const {
+		if(limit >= 0 && index >= limit) {
+			return false;
+		}
+		if(m_occludePeriod > 0) {
+			return (frame + long(stagger)*long(index)) % m_occludePeriod >= m_occludeLength;
+		}
+		return true;
+	}
+
+	cPrecisionClock m_clock;
+	float m_frequency;
+	int m_markerLimit;
+	int m_rigidLimit;
+	int m_occludePeriod;
+	int m_occludeLength;
+	int m_ttlPeriod;
+	bool m_ramp;
+	double m_start;
+	long m_markerFrame;        //last frame handed out by getMarkers
+	long m_rigidFrame;         //last frame handed out by getRigids
+	int m_status;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
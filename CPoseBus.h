@@ -0,0 +1,200 @@
+//Every frame's poses published in shared memory, so other processes on the machine
+//(loggers, analysis tools) can read them without a second OWL connection as a slave.
+//
+//The region is a header, a table saying what each sensor is, and a ring of frames:
+//
+//   SPoseBusHeader                  magic, version, sizes, frames published
+//   SPoseBusSensor[sensorCount]     one per sensor, in plugin order (user[0])
+//   ringFrames slots, slotBytes each:
+//      SPoseBusSlot                 seqlock sequence, frame index, time
+//      SPoseBusEntry[sensorCount]   each sensor's latest sample as of that frame
+//
+//Only the read thread writes. Each slot is a seqlock (as cPoseSeqlock): the sequence is
+//odd while the slot is rewritten, a reader checks it is even and unchanged around its
+//read and that the slot still holds the frame it wanted. Readers never block the writer;
+//one that falls more than the ring behind has lost those frames. Readers use
+//cPoseBusReader (CPoseBusClient.h), which only needs this header and boost.
+//
+//Native shared memory on Windows (gone with the last handle), POSIX shm elsewhere
+//(removed when the writer closes).
+
+#ifndef CPoseBusH
+#define CPoseBusH
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#if defined(_WIN32)
+#include <boost/interprocess/windows_shared_memory.hpp>
+#else
+#include <boost/interprocess/shared_memory_object.hpp>
+#endif
+
+const boost::uint32_t POSE_BUS_MAGIC = 0x42505350;    //"PSPB"
+const boost::uint32_t POSE_BUS_VERSION = 1;
+const unsigned int POSE_BUS_FRAMES = 256;             //frames in the ring
+const unsigned int POSE_BUS_ALIGN = 64;               //table and slots start on cache lines
+
+enum EPoseBusSensorType {
+	POSE_BUS_POINT = 0,           //a marker position, identity orientation
+	POSE_BUS_RIGID = 1,           //OWL rigid
+	POSE_BUS_SOLVED_RIGID = 2,    //rigid solved in the plugin from its markers
+	POSE_BUS_SEGMENT = 3          //midpoint and direction of two marker groups
+};
+
+struct SPoseBusHeader {
+	boost::uint32_t magic;
+	boost::uint32_t version;
+	boost::uint32_t sensorCount;
+	boost::uint32_t ringFrames;                 //a power of two
+	boost::uint32_t slotBytes;                  //slot header and entries, padded
+	boost::uint32_t sensorTable;                //byte offsets from the start of the region
+	boost::uint32_t firstSlot;
+	boost::uint32_t reserved;
+	double frequency;                           //OWL frequency
+	boost::atomic<boost::uint32_t> published;   //frames published so far, the newest is published - 1
+	boost::atomic<boost::uint32_t> live;        //1 while the writer is running
+};
+
+struct SPoseBusSensor {
+	boost::int32_t id;                          //the plugin's sensor id
+	boost::int32_t type;                        //EPoseBusSensorType
+	boost::int32_t markerCount;
+	boost::int32_t firstMarker;                 //OWL marker id of the first marker
+};
+
+struct SPoseBusSlot {
+	boost::atomic<boost::uint32_t> sequence;    //odd while written
+	boost::uint32_t frame;                      //publish index held (the slot is frame % ringFrames)
+	double time;                                //as dataRecordMember::time
+};
+
+struct SPoseBusEntry {
+	float pose[7];                              //Vizard coordinates, sensor data[0..6] order
+	float cond;                                 //<= 0.1 not seen this frame (pose is the last one)
+	boost::uint32_t ttl;
+	boost::uint32_t flags;                      //ERecordFlags
+};
+
+//byte layout shared by the writer and the readers
+inline boost::uint32_t PoseBusAligned(const size_t& bytes) {
+	return boost::uint32_t((bytes + POSE_BUS_ALIGN - 1)/POSE_BUS_ALIGN*POSE_BUS_ALIGN);
+}
+inline boost::uint32_t PoseBusSlotBytes(const unsigned int& sensors) {
+	return PoseBusAligned(sizeof(SPoseBusSlot) + sensors*sizeof(SPoseBusEntry));
+}
+
+class cPoseBusWriter {
+public:
+
+	cPoseBusWriter() : m_header(NULL), m_published(0) {}
+
+	~cPoseBusWriter() {
+		close();
+	}
+
+	//Make the region name for sensors (one per sensor, in plugin order). Any old region
+	//of that name is replaced. Returns false (and writes nothing later) if it could not be made.
+	bool create(const std::string& name, const std::vector<SPoseBusSensor>& sensors, const double& frequency) {
+		close();
+		using namespace boost::interprocess;
+		boost::uint32_t table = PoseBusAligned(sizeof(SPoseBusHeader));
+		boost::uint32_t first = table + PoseBusAligned(sensors.size()*sizeof(SPoseBusSensor));
+		boost::uint32_t slotBytes = PoseBusSlotBytes(sensors.size());
+		size_t size = size_t(first) + size_t(POSE_BUS_FRAMES)*slotBytes;
+		try {
+#if defined(_WIN32)
+			m_memory.reset(new windows_shared_memory(create_only, name.c_str(), read_write, size));
+#else
+			shared_memory_object::remove(name.c_str());
+			m_memory.reset(new shared_memory_object(create_only, name.c_str(), read_write));
+			m_memory->truncate(offset_t(size));
+#endif
+			m_region.reset(new mapped_region(*m_memory, read_write));
+		} catch(const interprocess_exception&) {
+			m_region.reset();
+			m_memory.reset();
+			return false;
+		}
+		m_name = name;
+		char* base = static_cast<char*>(m_region->get_address());
+		memset(base, 0, size);
+		m_header = reinterpret_cast<SPoseBusHeader*>(base);
+		m_header->sensorCount = boost::uint32_t(sensors.size());
+		m_header->ringFrames = POSE_BUS_FRAMES;
+		m_header->slotBytes = slotBytes;
+		m_header->sensorTable = table;
+		m_header->firstSlot = first;
+		m_header->frequency = frequency;
+		if(!sensors.empty()) {
+			memcpy(base + table, &sensors[0], sensors.size()*sizeof(SPoseBusSensor));
+		}
+		m_slots = base + first;
+		m_published = 0;
+		m_header->live.store(1, boost::memory_order_relaxed);
+		m_header->version = POSE_BUS_VERSION;
+		//readers check the magic first, it goes in after everything else
+		boost::atomic_thread_fence(boost::memory_order_release);
+		m_header->magic = POSE_BUS_MAGIC;
+		return true;
+	}
+
+	bool isOpen() const {
+		return m_header != NULL;
+	}
+
+	//Tell readers the writer is gone and drop the region.
+	void close() {
+		if(m_header == NULL) {
+			return;
+		}
+		m_header->live.store(0, boost::memory_order_release);
+		m_region.reset();
+		m_memory.reset();
+#if !defined(_WIN32)
+		boost::interprocess::shared_memory_object::remove(m_name.c_str());
+#endif
+		m_header = NULL;
+	}
+
+	//Read thread only. entries holds every sensor's latest sample (sensorCount of them).
+	void publish(const double& time, const SPoseBusEntry* entries) {
+		if(m_header == NULL) {
+			return;
+		}
+		SPoseBusSlot* slot = reinterpret_cast<SPoseBusSlot*>(m_slots + size_t(m_published & (POSE_BUS_FRAMES - 1))*m_header->slotBytes);
+		boost::uint32_t seq = slot->sequence.load(boost::memory_order_relaxed);
+		slot->sequence.store(seq + 1, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_release);
+		slot->frame = m_published;
+		slot->time = time;
+		memcpy(reinterpret_cast<char*>(slot) + sizeof(SPoseBusSlot), entries, m_header->sensorCount*sizeof(SPoseBusEntry));
+		slot->sequence.store(seq + 2, boost::memory_order_release);
+		++m_published;
+		m_header->published.store(m_published, boost::memory_order_release);
+	}
+
+private:
+	//not copyable
+	cPoseBusWriter(const cPoseBusWriter&);
+	cPoseBusWriter& operator=(const cPoseBusWriter&);
+
+#if defined(_WIN32)
+	boost::scoped_ptr<boost::interprocess::windows_shared_memory> m_memory;
+#else
+	boost::scoped_ptr<boost::interprocess::shared_memory_object> m_memory;
+#endif
+	boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+	std::string m_name;
+	SPoseBusHeader* m_header;
+	char* m_slots;
+	boost::uint32_t m_published;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,152 @@
+//Reading the pose bus (CPoseBus.h) from another process.
+//
+//   cPoseBusReader bus;
+//   if(bus.attach("PhaseSpacePoseBus")) {
+//      boost::uint32_t next = bus.published();
+//      ...
+//      while(next < bus.published()) {
+//         const SPoseBusSlot* slot = bus.begin(next);       //in place, no copy
+//         ... use slot->time and bus.entries(slot)[i] ...
+//         if(!bus.end(slot, next)) { ... frame was overwritten while read, drop what was used ... }
+//         ++next;
+//      }
+//   }
+//
+//begin() and end() are the two halves of the seqlock read, anything taken from the slot
+//in between is only good if end() returns true. read() does the same with a copy.
+//A reader more than ringFrames() behind gets begin() == NULL for the frames it lost,
+//skip to published() - ringFrames() (or to the newest) and carry on.
+
+#ifndef CPoseBusClientH
+#define CPoseBusClientH
+
+#include "CPoseBus.h"
+
+class cPoseBusReader {
+public:
+
+	cPoseBusReader() : m_header(NULL), m_base(NULL) {}
+
+	//Map the bus read only. Returns false if there is no bus of that name (the plugin has
+	//not started, or was not asked to publish) or it is not one this header understands.
+	bool attach(const std::string& name) {
+		detach();
+		using namespace boost::interprocess;
+		try {
+#if defined(_WIN32)
+			m_memory.reset(new windows_shared_memory(open_only, name.c_str(), read_only));
+#else
+			m_memory.reset(new shared_memory_object(open_only, name.c_str(), read_only));
+#endif
+			m_region.reset(new mapped_region(*m_memory, read_only));
+		} catch(const interprocess_exception&) {
+			detach();
+			return false;
+		}
+		m_base = static_cast<const char*>(m_region->get_address());
+		const SPoseBusHeader* header = reinterpret_cast<const SPoseBusHeader*>(m_base);
+		if(m_region->get_size() < sizeof(SPoseBusHeader) || header->magic != POSE_BUS_MAGIC) {
+			detach();
+			return false;
+		}
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		if(header->version != POSE_BUS_VERSION
+			|| m_region->get_size() < size_t(header->firstSlot) + size_t(header->ringFrames)*header->slotBytes) {
+			detach();
+			return false;
+		}
+		m_header = header;
+		return true;
+	}
+
+	void detach() {
+		m_region.reset();
+		m_memory.reset();
+		m_header = NULL;
+		m_base = NULL;
+	}
+
+	bool attached() const {
+		return m_header != NULL;
+	}
+
+	//false once the plugin has closed (no more frames will come)
+	bool live() const {
+		return m_header->live.load(boost::memory_order_acquire) != 0;
+	}
+
+	unsigned int sensorCount() const {
+		return m_header->sensorCount;
+	}
+
+	const SPoseBusSensor& sensor(const unsigned int& i) const {
+		return reinterpret_cast<const SPoseBusSensor*>(m_base + m_header->sensorTable)[i];
+	}
+
+	unsigned int ringFrames() const {
+		return m_header->ringFrames;
+	}
+
+	double frequency() const {
+		return m_header->frequency;
+	}
+
+	//frames published so far, the newest is published() - 1
+	boost::uint32_t published() const {
+		return m_header->published.load(boost::memory_order_acquire);
+	}
+
+	//Start reading frame in place, NULL if it is not in the ring (lost or not yet there)
+	//or is being written right now.
+	const SPoseBusSlot* begin(const boost::uint32_t& frame) const {
+		const SPoseBusSlot* slot = reinterpret_cast<const SPoseBusSlot*>(m_base + m_header->firstSlot
+			+ size_t(frame & (m_header->ringFrames - 1))*m_header->slotBytes);
+		boost::uint32_t seq = slot->sequence.load(boost::memory_order_acquire);
+		if((seq & 1) != 0 || slot->frame != frame || seq == 0) {
+			return NULL;
+		}
+		m_sequence = seq;
+		return slot;
+	}
+
+	//the slot's sensorCount() entries
+	const SPoseBusEntry* entries(const SPoseBusSlot* slot) const {
+		return reinterpret_cast<const SPoseBusEntry*>(slot + 1);
+	}
+
+	//Finish reading frame, true if nothing was rewritten since begin().
+	bool end(const SPoseBusSlot* slot, const boost::uint32_t& frame) const {
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		return slot->sequence.load(boost::memory_order_relaxed) == m_sequence && slot->frame == frame;
+	}
+
+	//Copy frame out (entries needs sensorCount()), false if it could not be read.
+	bool read(const boost::uint32_t& frame, double& time, SPoseBusEntry* entries) const {
+		const SPoseBusSlot* slot = begin(frame);
+		if(slot == NULL) {
+			return false;
+		}
+		time = slot->time;
+		memcpy(entries, this->entries(slot), m_header->sensorCount*sizeof(SPoseBusEntry));
+		return end(slot, frame);
+	}
+
+private:
+	//not copyable
+	cPoseBusReader(const cPoseBusReader&);
+	cPoseBusReader& operator=(const cPoseBusReader&);
+
+#if defined(_WIN32)
+	boost::scoped_ptr<boost::interprocess::windows_shared_memory> m_memory;
+#else
+	boost::scoped_ptr<boost::interprocess::shared_memory_object> m_memory;
+#endif
+	boost::scoped_ptr<boost::interprocess::mapped_region> m_region;
+	const SPoseBusHeader* m_header;
+	const char* m_base;
+	mutable boost::uint32_t m_sequence;         //of the slot begin() handed out
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
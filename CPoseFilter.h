@@ -0,0 +1,343 @@
+//Smoothing filters for every sensor's pose, run by the read thread at the full OWL rate.
+//
+//Kinds (per slot, see SPoseFilterSettings for the parameters):
+//   POSE_FILTER_NONE              the pose as it is
+//   POSE_FILTER_EXPONENTIAL       y += (1 - exp(-dt/tau))*(x - y)
+//   POSE_FILTER_ONE_EURO          One Euro (Casiez et al. 2012): a low pass whose cutoff
+//                                 rises with speed, so it is smooth at rest and does not
+//                                 lag fast moves
+//   POSE_FILTER_SAVITZKY_GOLAY    least squares polynomial over the last window samples,
+//                                 read off lag samples back from the newest (lag 0 has no
+//                                 delay, lag (window-1)/2 is the classic centred smoother)
+//All seven channels (Vizard data[0..6] order) go through the filter; the quaternion is
+//kept in the hemisphere of the previous output and normalized afterwards.
+//
+//Same structure of arrays layout and use as cPoseTransformBatch: setInput() the
+//frame's good poses, apply(), getOutput(). Each kind runs as one loop over its
+//slots for every channel.
+//A slot restarts from its input when it is (re)configured or after a gap of
+//POSE_FILTER_MAX_GAP without a good sample.
+
+#ifndef CPoseFilterH
+#define CPoseFilterH
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+enum EPoseFilter {
+	POSE_FILTER_NONE = 0,
+	POSE_FILTER_EXPONENTIAL = 1,
+	POSE_FILTER_ONE_EURO = 2,
+	POSE_FILTER_SAVITZKY_GOLAY = 3,
+	POSE_FILTER_COUNT
+};
+
+const int POSE_FILTER_CHANNELS = 7;
+const int POSE_FILTER_MAX_WINDOW = 15;
+const double POSE_FILTER_MAX_GAP = 0.1;    //seconds
+
+//parameters of one slot's filter
+struct SPoseFilterSettings {
+	int type;                     //EPoseFilter
+	float a;                      //exponential: time constant (s); One Euro: minimum cutoff (Hz); SG: window (odd)
+	float b;                      //One Euro: beta (s/unit); SG: lag (samples)
+	float c;                      //One Euro: derivative cutoff (Hz)
+};
+
+class cPoseFilterBatch {
+public:
+
+	cPoseFilterBatch() : m_count(0), m_listsDirty(true) {}
+
+	//Number of slots. Existing slots keep their state.
+	void resize(const int& count) {
+		m_count = count;
+		m_owner.resize(count, -1);
+		m_settings.resize(count);
+		m_last.resize(count, 0.0);
+		m_dt.resize(count, 0.0f);
+		m_fresh.resize(count, 0);
+		m_started.resize(count, false);
+		m_head.resize(count, 0);
+		m_filled.resize(count, 0);
+		m_coefficients.resize(count*POSE_FILTER_MAX_WINDOW, 0.0f);
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			m_in[k].resize(count, 0.0f);
+			m_out[k].resize(count, 0.0f);
+			m_derivative[k].resize(count, 0.0f);
+			m_history[k].resize(count*POSE_FILTER_MAX_WINDOW, 0.0f);
+		}
+		m_listsDirty = true;
+	}
+
+	//Set a slot's filter for the sensor owner. The slot restarts only if either changed.
+	void configure(const int& slot, const int& owner, const SPoseFilterSettings& settings) {
+		const SPoseFilterSettings& old = m_settings[slot];
+		if(m_owner[slot] == owner && old.type == settings.type && old.a == settings.a
+			&& old.b == settings.b && old.c == settings.c) {
+			return;
+		}
+		m_owner[slot] = owner;
+		m_settings[slot] = settings;
+		m_started[slot] = false;
+		if(settings.type == POSE_FILTER_SAVITZKY_GOLAY) {
+			savitzkyGolay(int(settings.a), int(settings.b), &m_coefficients[slot*POSE_FILTER_MAX_WINDOW]);
+		}
+		m_listsDirty = true;
+	}
+
+	//Check settings before they are used, returns an explanation if they are no good.
+	static const char* invalid(const SPoseFilterSettings& s) {
+		switch(s.type) {
+		case POSE_FILTER_NONE:
+			return NULL;
+		case POSE_FILTER_EXPONENTIAL:
+			return s.a > 0.0f ? NULL : "the time constant must be positive";
+		case POSE_FILTER_ONE_EURO:
+			return s.a > 0.0f && s.b >= 0.0f && s.c > 0.0f ? NULL : "cutoffs must be positive and beta not negative";
+		case POSE_FILTER_SAVITZKY_GOLAY:
+			if(int(s.a) < 3 || int(s.a) > POSE_FILTER_MAX_WINDOW || int(s.a) % 2 == 0) {
+				return "the window must be odd, 3 to 15";
+			}
+			return int(s.b) >= 0 && int(s.b) < int(s.a) ? NULL : "the lag must be from 0 to window - 1";
+		}
+		return "unknown filter";
+	}
+
+	bool active(const int& slot) const {
+		return m_settings[slot].type != POSE_FILTER_NONE;
+	}
+
+	//A good sample for a slot, pose in data[0..6] order, t when it was taken (seconds).
+	void setInput(const int& slot, const float pose[POSE_FILTER_CHANNELS], const double& t) {
+		m_fresh[slot] = 1;
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			m_in[k][slot] = pose[k];
+		}
+		if(m_started[slot] && t > m_last[slot] && t - m_last[slot] <= POSE_FILTER_MAX_GAP) {
+			m_dt[slot] = float(t - m_last[slot]);
+			//keep the quaternion in the hemisphere of the last output
+			float dot = 0.0f;
+			for(int k = 3; k < POSE_FILTER_CHANNELS; ++k) {
+				dot += m_in[k][slot]*m_out[k][slot];
+			}
+			if(dot < 0.0f) {
+				for(int k = 3; k < POSE_FILTER_CHANNELS; ++k) {
+					m_in[k][slot] = -m_in[k][slot];
+				}
+			}
+		} else {
+			restart(slot);
+		}
+		m_last[slot] = t;
+	}
+
+	//Filter every slot given an input since the last call.
+	void apply() {
+		if(m_listsDirty) {
+			buildLists();
+		}
+		exponential();
+		oneEuro();
+		savitzkyGolay();
+		for(int slot = 0; slot < m_count; ++slot) {
+			if(!m_fresh[slot]) {
+				continue;
+			}
+			float n = 0.0f;
+			for(int k = 3; k < POSE_FILTER_CHANNELS; ++k) {
+				n += m_out[k][slot]*m_out[k][slot];
+			}
+			if(n > 0.0f) {
+				n = 1.0f/sqrtf(n);
+				for(int k = 3; k < POSE_FILTER_CHANNELS; ++k) {
+					m_out[k][slot] *= n;
+				}
+			}
+			m_fresh[slot] = 0;
+			m_dt[slot] = 0.0f;
+		}
+	}
+
+	//filtered pose of a slot (data[0..6] order)
+	void getOutput(const int& slot, float out[POSE_FILTER_CHANNELS]) const {
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			out[k] = m_out[k][slot];
+		}
+	}
+
+private:
+	void buildLists() {
+		for(int type = 0; type < POSE_FILTER_COUNT; ++type) {
+			m_slots[type].clear();
+		}
+		for(int slot = 0; slot < m_count; ++slot) {
+			m_slots[m_settings[slot].type].push_back(slot);
+		}
+		m_listsDirty = false;
+	}
+
+	void restart(const int& slot) {
+		m_started[slot] = true;
+		m_head[slot] = 0;
+		m_filled[slot] = 0;
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			m_out[k][slot] = m_in[k][slot];
+			m_derivative[k][slot] = 0.0f;
+		}
+	}
+
+	//slots with dt > 0 have a new sample to take in (dt 0 means restarted or not updated)
+	void exponential() {
+		const std::vector<int>& slots = m_slots[POSE_FILTER_EXPONENTIAL];
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			const float* in = &m_in[k][0];
+			float* out = &m_out[k][0];
+			for(size_t i = 0; i < slots.size(); ++i) {
+				int s = slots[i];
+				if(m_dt[s] > 0.0f) {
+					float alpha = 1.0f - expf(-m_dt[s]/m_settings[s].a);
+					out[s] += alpha*(in[s] - out[s]);
+				}
+			}
+		}
+	}
+
+	static float smoothing(const float& dt, const float& cutoff) {
+		float tau = 1.0f/(6.2831853f*cutoff);
+		return 1.0f/(1.0f + tau/dt);
+	}
+
+	void oneEuro() {
+		const std::vector<int>& slots = m_slots[POSE_FILTER_ONE_EURO];
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			const float* in = &m_in[k][0];
+			float* out = &m_out[k][0];
+			float* derivative = &m_derivative[k][0];
+			for(size_t i = 0; i < slots.size(); ++i) {
+				int s = slots[i];
+				float dt = m_dt[s];
+				if(dt > 0.0f) {
+					const SPoseFilterSettings& p = m_settings[s];
+					derivative[s] += smoothing(dt, p.c)*((in[s] - out[s])/dt - derivative[s]);
+					float cutoff = p.a + p.b*fabsf(derivative[s]);
+					out[s] += smoothing(dt, cutoff)*(in[s] - out[s]);
+				}
+			}
+		}
+	}
+
+	void savitzkyGolay() {
+		const std::vector<int>& slots = m_slots[POSE_FILTER_SAVITZKY_GOLAY];
+		for(size_t i = 0; i < slots.size(); ++i) {
+			int s = slots[i];
+			if(!m_fresh[s]) {
+				continue;
+			}
+			if(m_filled[s] > 0) {
+				m_head[s] = (m_head[s] + 1) % POSE_FILTER_MAX_WINDOW;
+			}
+			if(m_filled[s] < POSE_FILTER_MAX_WINDOW) {
+				++m_filled[s];
+			}
+		}
+		for(int k = 0; k < POSE_FILTER_CHANNELS; ++k) {
+			const float* in = &m_in[k][0];
+			float* out = &m_out[k][0];
+			float* history = &m_history[k][0];
+			for(size_t i = 0; i < slots.size(); ++i) {
+				int s = slots[i];
+				if(!m_fresh[s]) {
+					continue;
+				}
+				float* h = history + s*POSE_FILTER_MAX_WINDOW;
+				h[m_head[s]] = in[s];
+				int window = int(m_settings[s].a);
+				if(m_filled[s] < window) {
+					out[s] = in[s];
+					continue;
+				}
+				const float* c = &m_coefficients[s*POSE_FILTER_MAX_WINDOW];
+				float sum = 0.0f;
+				int at = m_head[s];
+				for(int j = 0; j < window; ++j) {
+					sum += c[j]*h[at];
+					at = at == 0 ? POSE_FILTER_MAX_WINDOW - 1 : at - 1;
+				}
+				out[s] = sum;
+			}
+		}
+	}
+
+	//Weights c[j] on the sample j back from the newest for a polynomial fit (order 2,
+	//1 for a window of 3) evaluated lag samples back.
+	static void savitzkyGolay(const int& window, const int& lag, float* c) {
+		int order = window > 3 ? 2 : 1;
+		int n = order + 1;
+		//normal matrix sum over tau of tau^(r+s), tau = -j
+		double m[3][3] = {{0.0}};
+		for(int j = 0; j < window; ++j) {
+			double p[5] = {1.0, 0.0, 0.0, 0.0, 0.0};
+			for(int e = 1; e < 5; ++e) {
+				p[e] = p[e-1]*double(-j);
+			}
+			for(int r = 0; r < n; ++r) {
+				for(int q = 0; q < n; ++q) {
+					m[r][q] += p[r + q];
+				}
+			}
+		}
+		//solve m w = e(-lag) so the weights are e(-lag)^T m^-1 A^T
+		double w[3] = {1.0, -double(lag), double(lag)*double(lag)};
+		for(int col = 0; col < n; ++col) {
+			int pivot = col;
+			for(int r = col + 1; r < n; ++r) {
+				if(fabs(m[r][col]) > fabs(m[pivot][col])) {
+					pivot = r;
+				}
+			}
+			for(int q = 0; q < n; ++q) {
+				double tmp = m[col][q]; m[col][q] = m[pivot][q]; m[pivot][q] = tmp;
+			}
+			double tmp = w[col]; w[col] = w[pivot]; w[pivot] = tmp;
+			for(int r = 0; r < n; ++r) {
+				if(r != col) {
+					double f = m[r][col]/m[col][col];
+					for(int q = 0; q < n; ++q) {
+						m[r][q] -= f*m[col][q];
+					}
+					w[r] -= f*w[col];
+				}
+			}
+		}
+		for(int r = 0; r < n; ++r) {
+			w[r] /= m[r][r];
+		}
+		for(int j = 0; j < POSE_FILTER_MAX_WINDOW; ++j) {
+			double tau = -double(j);
+			c[j] = j < window ? float(w[0] + w[1]*tau + (order > 1 ? w[2]*tau*tau : 0.0)) : 0.0f;
+		}
+	}
+
+	int m_count;
+	bool m_listsDirty;
+	std::vector<int> m_slots[POSE_FILTER_COUNT];          //slots of each kind
+	std::vector<int> m_owner;                              //sensor a slot was configured for
+	std::vector<SPoseFilterSettings> m_settings;
+	std::vector<double> m_last;                            //time of the last good sample
+	std::vector<bool> m_started;
+	std::vector<float> m_dt;                               //this frame's step, 0 if no new sample
+	std::vector<char> m_fresh;                             //slot took a sample this frame
+	std::vector<int> m_head;                               //newest history entry (SG)
+	std::vector<int> m_filled;                             //history entries in use (SG)
+	std::vector<float> m_coefficients;                     //MAX_WINDOW per slot (SG)
+	std::vector<float> m_in[POSE_FILTER_CHANNELS];
+	std::vector<float> m_out[POSE_FILTER_CHANNELS];
+	std::vector<float> m_derivative[POSE_FILTER_CHANNELS]; //One Euro
+	std::vector<float> m_history[POSE_FILTER_CHANNELS];    //MAX_WINDOW per slot (SG)
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,249 @@
+//Every sample of a sensor at the full OWL rate, for scripts that analyse more than the
+//one pose per render frame UpdateSensor gives them (e.g. strokes or reaches).
+//
+//The read thread pushes each frame's sample into a fixed ring and never waits: once the
+//ring is full the oldest sample is overwritten. One reader (the Vizard thread) keeps a
+//cursor and readNew() hands it everything pushed since its last read, oldest first, as
+//one contiguous batch. Samples overwritten before they were read are counted as lost.
+//
+//sampleAt() looks up the pose at any time still in the ring without moving the cursor:
+//frames come at a near constant rate, so the index is found from the time and then
+//stepped to the two samples either side (usually no steps), which are interpolated
+//(position linear, orientation slerp).
+//
+//The writer claims a slot before writing it and publishes it after (seqlock style), so
+//a reader that copied a slot while it was being rewritten finds out and drops it.
+
+#ifndef CPoseHistoryH
+#define CPoseHistoryH
+
+#include <math.h>
+#include <string.h>
+#include <boost/atomic.hpp>
+
+//One sample, laid out for callers outside the plugin (ReadSensorSamples):
+//8 byte time, 7 floats pose, float cond, 2 unsigned ints, 48 bytes in all.
+struct SPoseSample {
+	double time;                  //as dataRecordMember::time (clock synced Vizard tick)
+	float pose[7];                //Vizard coordinates, sensor data[0..6] order
+	float cond;                   //OWL condition, <= 0.1 means the pose was not seen
+	unsigned int ttl;             //TTL inputs in the frame
+	unsigned int flags;           //ERecordFlags
+};
+
+const unsigned int POSE_HISTORY_SIZE = 4096;    //samples per sensor, a little over 4 s at 960 Hz
+
+class cPoseHistory {
+public:
+
+	//capacity is rounded up to a power of two
+	explicit cPoseHistory(const unsigned int& capacity = POSE_HISTORY_SIZE) : m_claimed(0), m_head(0), m_cursor(0), m_lost(0) {
+		unsigned int size = 1;
+		while(size < capacity) {
+			size <<= 1;
+		}
+		m_mask = size - 1;
+		m_buffer = new SPoseSample[size];
+		memset(m_buffer, 0, size*sizeof(SPoseSample));
+	}
+
+	~cPoseHistory() {
+		delete[] m_buffer;
+	}
+
+	unsigned int capacity() const {
+		return m_mask + 1;
+	}
+
+	//New capacity (rounded up to a power of two), emptying the ring. Neither the writer
+	//nor the reader may be using it.
+	void resize(const unsigned int& capacity) {
+		unsigned int size = 1;
+		while(size < capacity) {
+			size <<= 1;
+		}
+		delete[] m_buffer;
+		m_mask = size - 1;
+		m_buffer = new SPoseSample[size];
+		memset(m_buffer, 0, size*sizeof(SPoseSample));
+		m_claimed.store(0, boost::memory_order_relaxed);
+		m_head.store(0, boost::memory_order_release);
+		m_cursor = 0;
+		m_lost = 0;
+	}
+
+	//Writer only, never blocks.
+	void push(const SPoseSample& s) {
+		unsigned int head = m_head.load(boost::memory_order_relaxed);
+		m_claimed.store(head + 1, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_release);
+		m_buffer[head & m_mask] = s;
+		m_head.store(head + 1, boost::memory_order_release);
+	}
+
+	//Reader only. Samples since the last read (approximate while the writer is active),
+	//at most the capacity.
+	unsigned int waiting() const {
+		unsigned int pending = m_head.load(boost::memory_order_acquire) - m_cursor;
+		return pending > m_mask ? m_mask + 1 : pending;
+	}
+
+	//Reader only. Copies up to maxCount of the samples since the last read to out, oldest
+	//first, and returns the count. Anything left over is returned by the next call.
+	unsigned int readNew(SPoseSample* out, const unsigned int& maxCount) {
+		unsigned int head = m_head.load(boost::memory_order_acquire);
+		unsigned int from = m_cursor;
+		if(head - from > m_mask + 1) {
+			m_lost += head - from - (m_mask + 1);
+			from = head - (m_mask + 1);
+		}
+		unsigned int count = head - from;
+		if(count > maxCount) {
+			count = maxCount;
+		}
+		for(unsigned int i = 0; i < count; ++i) {
+			out[i] = m_buffer[(from + i) & m_mask];
+		}
+
+		//slots the writer may have started on since are not trusted
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		unsigned int safe = m_claimed.load(boost::memory_order_relaxed) - (m_mask + 1);
+		unsigned int torn = 0;
+		while(torn < count && int(from + torn - safe) < 0) {
+			++torn;
+		}
+		if(torn > 0) {
+			memmove(out, out + torn, (count - torn)*sizeof(SPoseSample));
+			m_lost += torn;
+		}
+		m_cursor = from + count;
+		return count - torn;
+	}
+
+	//Reader only. Skips everything pushed so far, the next read starts from now.
+	void skip() {
+		m_cursor = m_head.load(boost::memory_order_acquire);
+	}
+
+	//Reader only. Samples overwritten before they were read.
+	unsigned long lost() const {
+		return m_lost;
+	}
+
+	//The sample at time t (the clock of SPoseSample::time), from the two either side:
+	//interpolated if both were seen (cond > 0.1), otherwise the nearer one that was seen
+	//(or just the nearer one). With interpolate false the nearer one, again preferring one
+	//that was seen.
+	//Returns false if t is not inside the ring. Safe from any one thread besides the writer.
+	bool sampleAt(const double& t, const bool& interpolate, SPoseSample& out) const {
+		//a writer lapping the lookup makes it start over
+		for(int attempt = 0; attempt < 4; ++attempt) {
+			unsigned int head = m_head.load(boost::memory_order_acquire);
+			unsigned int kept = head > m_mask ? m_mask + 1 : head;
+			if(kept == 0) {
+				return false;
+			}
+			unsigned int oldest = head - kept, newest = head - 1;
+			double first = slot(oldest).time, last = slot(newest).time;
+			bool inside = t >= first && t <= last;
+			SPoseSample a, b;
+			if(inside) {
+				unsigned int i = oldest;
+				if(last > first) {
+					i += (unsigned int)((t - first)/(last - first)*double(kept - 1));
+				}
+				if(i > newest) {
+					i = newest;
+				}
+				while(i != oldest && slot(i).time > t) {
+					--i;
+				}
+				while(i != newest && slot(i + 1).time <= t) {
+					++i;
+				}
+				a = slot(i);
+				b = i != newest ? slot(i + 1) : a;
+			}
+			boost::atomic_thread_fence(boost::memory_order_acquire);
+			unsigned int safe = m_claimed.load(boost::memory_order_relaxed) - (m_mask + 1);
+			if(int(oldest - safe) < 0) {
+				continue;
+			}
+			if(!inside) {
+				return false;
+			}
+			blend(a, b, t, interpolate, out);
+			return true;
+		}
+		return false;
+	}
+
+private:
+	const SPoseSample& slot(const unsigned int& index) const {
+		return m_buffer[index & m_mask];
+	}
+
+	//a at or before t, b after it (or a again)
+	static void blend(const SPoseSample& a, const SPoseSample& b, const double& t, const bool& interpolate, SPoseSample& out) {
+		bool aSeen = a.cond > 0.1f, bSeen = b.cond > 0.1f;
+		bool nearerA = t - a.time <= b.time - t;
+		if(!interpolate || !aSeen || !bSeen || b.time <= a.time) {
+			if(aSeen != bSeen) {
+				out = aSeen ? a : b;
+			} else {
+				out = nearerA ? a : b;
+			}
+			return;
+		}
+		float f = float((t - a.time)/(b.time - a.time));
+		for(int k = 0; k < 3; ++k) {
+			out.pose[k] = a.pose[k] + f*(b.pose[k] - a.pose[k]);
+		}
+		slerp(a.pose + 3, b.pose + 3, f, out.pose + 3);
+		out.time = t;
+		out.cond = a.cond < b.cond ? a.cond : b.cond;
+		out.ttl = nearerA ? a.ttl : b.ttl;
+		out.flags = a.flags | b.flags;
+	}
+
+	//unit quaternions (any order, all four components used the same way), shorter way round
+	static void slerp(const float* p, const float* q, const float& f, float* out) {
+		double d = p[0]*q[0] + p[1]*q[1] + p[2]*q[2] + p[3]*q[3];
+		double sign = d < 0.0 ? -1.0 : 1.0;
+		d *= sign;
+		double wp = 1.0 - f, wq = f;
+		if(d < 0.9995) {
+			double angle = acos(d);
+			double s = sin(angle);
+			wp = sin((1.0 - f)*angle)/s;
+			wq = sin(f*angle)/s;
+		}
+		double r[4], n = 0.0;
+		for(int k = 0; k < 4; ++k) {
+			r[k] = wp*p[k] + sign*wq*q[k];
+			n += r[k]*r[k];
+		}
+		n = sqrt(n);
+		for(int k = 0; k < 4; ++k) {
+			out[k] = float(r[k]/n);
+		}
+	}
+
+	//not copyable
+	cPoseHistory(const cPoseHistory&);
+	cPoseHistory& operator=(const cPoseHistory&);
+
+	char m_padFront[64];
+	boost::atomic<unsigned int> m_claimed;  //index + 1 of the slot being written (writer)
+	boost::atomic<unsigned int> m_head;     //samples published (writer)
+	char m_padMiddle[64];
+	unsigned int m_cursor;                  //next sample to read (reader)
+	unsigned long m_lost;                   //(reader)
+	char m_padBack[64];
+	unsigned int m_mask;
+	SPoseSample* m_buffer;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
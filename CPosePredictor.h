@@ -0,0 +1,254 @@
+//Short horizon pose prediction to hide tracking and render latency.
+//
+//The read thread feeds every good sample (Vizard coordinates, sensor data[0..6] order)
+//to update(), which tracks
+//   position      an alpha-beta-gamma filter: velocity and acceleration that follow a
+//                 constant velocity without lag, smoothing factor PREDICT_THETA
+//   orientation   angular velocity (world frame) from successive quaternions,
+//                 exponentially smoothed
+//The rates travel with the pose (SPoseSnapshot) and extrapolate() moves a pose dt
+//seconds ahead:
+//   PREDICT_HOLD          the pose as it is
+//   PREDICT_VELOCITY      p + v dt, orientation turned by w dt
+//   PREDICT_ACCELERATION  p + v dt + a dt^2/2, orientation turned by w dt
+//A gap in the samples longer than PREDICT_MAX_GAP restarts the rates from zero.
+//
+//evaluate() runs the same predictor over a recording and measures the error against
+//what was actually recorded dt later, for a set of horizons.
+
+#ifndef CPosePredictorH
+#define CPosePredictorH
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+enum EPredictMode {
+	PREDICT_HOLD = 0,
+	PREDICT_VELOCITY = 1,
+	PREDICT_ACCELERATION = 2,
+	PREDICT_MODE_COUNT
+};
+
+const double PREDICT_THETA = 0.8;          //alpha-beta-gamma smoothing, closer to 1 is smoother
+const double PREDICT_ANGULAR_ALPHA = 0.3;  //weight of each new angular velocity
+const double PREDICT_MAX_GAP = 0.1;        //seconds
+const double PREDICT_DEGREES = 57.295779513082323;
+
+//the motion state that goes out with a pose
+struct SPoseRates {
+	float velocity[3];            //units/s
+	float acceleration[3];        //units/s^2
+	float angular[3];             //rad/s, world frame
+};
+
+class cPosePredictor {
+public:
+
+	cPosePredictor() {
+		reset();
+	}
+
+	void reset() {
+		memset(&m_rates, 0, sizeof(m_rates));
+		memset(m_position, 0, sizeof(m_position));
+		memset(m_orientation, 0, sizeof(m_orientation));
+		m_time = 0.0;
+		m_samples = 0;
+	}
+
+	//A good sample at time t (seconds), pose in data[0..6] order (x, y, z, qx, qy, qz, qw).
+	//t should be when the sample was taken (e.g. the OWL frame number over the rate),
+	//arrival times bunch up when the reader falls behind and make the rates jump.
+	//A sample that is not later than the last one is ignored.
+	void update(const double& t, const float pose[7]) {
+		double dt = t - m_time;
+		if(m_samples > 0 && dt <= 0.0) {
+			return;
+		}
+		if(m_samples == 0 || dt > PREDICT_MAX_GAP) {
+			memset(&m_rates, 0, sizeof(m_rates));
+			for(int k = 0; k < 3; ++k) {
+				m_position[k] = pose[k];
+			}
+			memcpy(m_orientation, pose + 3, sizeof(m_orientation));
+			m_time = t;
+			m_samples = 1;
+			return;
+		}
+		double th = PREDICT_THETA;
+		double alpha = 1.0 - th*th*th;
+		double beta = 1.5*(1.0 - th*th)*(1.0 - th);
+		double gamma = 0.5*(1.0 - th)*(1.0 - th)*(1.0 - th);
+		for(int k = 0; k < 3; ++k) {
+			double v = m_rates.velocity[k];
+			double a = m_rates.acceleration[k];
+			double guess = m_position[k] + v*dt + 0.5*a*dt*dt;
+			double r = pose[k] - guess;
+			m_position[k] = guess + alpha*r;
+			m_rates.velocity[k] = float(v + a*dt + beta*r/dt);
+			m_rates.acceleration[k] = float(a + 2.0*gamma*r/(dt*dt));
+		}
+
+		//rotation from the last orientation to this one, as an angular velocity
+		float inverse[4] = {-m_orientation[0], -m_orientation[1], -m_orientation[2], m_orientation[3]};
+		float d[4];
+		multiply(pose + 3, inverse, d);
+		if(d[3] < 0.0f) {
+			d[0] = -d[0]; d[1] = -d[1]; d[2] = -d[2]; d[3] = -d[3];
+		}
+		double s = sqrt(double(d[0])*d[0] + double(d[1])*d[1] + double(d[2])*d[2]);
+		double scale = s > 1.0e-9 ? 2.0*atan2(s, double(d[3]))/(s*dt) : 2.0/dt;
+		for(int k = 0; k < 3; ++k) {
+			m_rates.angular[k] += float(PREDICT_ANGULAR_ALPHA*(scale*d[k] - m_rates.angular[k]));
+		}
+		memcpy(m_orientation, pose + 3, sizeof(m_orientation));
+		m_time = t;
+		++m_samples;
+	}
+
+	const SPoseRates& rates() const {
+		return m_rates;
+	}
+
+	//pose (data[0..6] order) moved dt seconds ahead with the given rates
+	static void extrapolate(const float pose[7], const SPoseRates& rates, const int& mode,
+		const double& dt, float out[7]) {
+		memcpy(out, pose, 7*sizeof(float));
+		if(mode == PREDICT_HOLD) {
+			return;
+		}
+		for(int k = 0; k < 3; ++k) {
+			double p = pose[k] + rates.velocity[k]*dt;
+			if(mode == PREDICT_ACCELERATION) {
+				p += 0.5*rates.acceleration[k]*dt*dt;
+			}
+			out[k] = float(p);
+		}
+		double w = sqrt(double(rates.angular[0])*rates.angular[0] + double(rates.angular[1])*rates.angular[1]
+			+ double(rates.angular[2])*rates.angular[2]);
+		if(w*dt < 1.0e-9) {
+			return;
+		}
+		double half = 0.5*w*dt;
+		double sn = sin(half)/w;
+		float turn[4] = {float(rates.angular[0]*sn), float(rates.angular[1]*sn), float(rates.angular[2]*sn), float(cos(half))};
+		multiply(turn, pose + 3, out + 3);
+		float n = sqrtf(out[3]*out[3] + out[4]*out[4] + out[5]*out[5] + out[6]*out[6]);
+		if(n > 0.0f) {
+			for(int k = 3; k < 7; ++k) {
+				out[k] /= n;
+			}
+		}
+	}
+
+	//error of each mode at one horizon
+	struct SEvaluation {
+		double horizon;                           //seconds
+		int count;                                //predictions compared
+		double position[PREDICT_MODE_COUNT];      //rms position error (recording units)
+		double angle[PREDICT_MODE_COUNT];         //rms orientation error (degrees)
+	};
+
+	//Run the predictor over samples (times in seconds, poses in data[0..6] order) and
+	//compare each prediction with the recording interpolated at t + horizon.
+	static std::vector<SEvaluation> evaluate(const std::vector<double>& times,
+		const std::vector<float>& poses, const std::vector<double>& horizons) {
+		std::vector<SEvaluation> result(horizons.size());
+		for(size_t h = 0; h < horizons.size(); ++h) {
+			memset(&result[h], 0, sizeof(SEvaluation));
+			result[h].horizon = horizons[h];
+		}
+		cPosePredictor predictor;
+		std::vector<size_t> ahead(horizons.size(), 0);
+		for(size_t i = 0; i < times.size(); ++i) {
+			const float* pose = &poses[7*i];
+			predictor.update(times[i], pose);
+			if(predictor.m_samples < 8) {
+				continue;
+			}
+			for(size_t h = 0; h < horizons.size(); ++h) {
+				double target = times[i] + horizons[h];
+				size_t& j = ahead[h];
+				if(j < i) {
+					j = i;
+				}
+				while(j < times.size() && times[j] < target) {
+					++j;
+				}
+				//skip the end of the recording and gaps
+				if(j >= times.size() || j == 0 || times[j] - times[j-1] > PREDICT_MAX_GAP) {
+					continue;
+				}
+				float actual[7];
+				interpolate(times[j-1], &poses[7*(j-1)], times[j], &poses[7*j], target, actual);
+				for(int mode = 0; mode < PREDICT_MODE_COUNT; ++mode) {
+					float guess[7];
+					extrapolate(pose, predictor.rates(), mode, horizons[h], guess);
+					double e = 0.0;
+					for(int k = 0; k < 3; ++k) {
+						e += double(guess[k] - actual[k])*(guess[k] - actual[k]);
+					}
+					result[h].position[mode] += e;
+					double angle = angleBetween(guess + 3, actual + 3)*PREDICT_DEGREES;
+					result[h].angle[mode] += angle*angle;
+				}
+				++result[h].count;
+			}
+		}
+		for(size_t h = 0; h < horizons.size(); ++h) {
+			for(int mode = 0; mode < PREDICT_MODE_COUNT; ++mode) {
+				if(result[h].count > 0) {
+					result[h].position[mode] = sqrt(result[h].position[mode]/result[h].count);
+					result[h].angle[mode] = sqrt(result[h].angle[mode]/result[h].count);
+				}
+			}
+		}
+		return result;
+	}
+
+private:
+	//quaternions in (x, y, z, w) order: out = a*b
+	static void multiply(const float a[4], const float b[4], float out[4]) {
+		float x = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+		float y = a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0];
+		float z = a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3];
+		float w = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+		out[0] = x; out[1] = y; out[2] = z; out[3] = w;
+	}
+
+	//radians between two orientations
+	static double angleBetween(const float a[4], const float b[4]) {
+		double d = fabs(double(a[0])*b[0] + double(a[1])*b[1] + double(a[2])*b[2] + double(a[3])*b[3]);
+		return d >= 1.0 ? 0.0 : 2.0*acos(d);
+	}
+
+	//linear position, normalized linear orientation (close enough a frame apart)
+	static void interpolate(const double& t0, const float a[7], const double& t1, const float b[7],
+		const double& t, float out[7]) {
+		double f = t1 > t0 ? (t - t0)/(t1 - t0) : 1.0;
+		for(int k = 0; k < 3; ++k) {
+			out[k] = float(a[k] + f*(b[k] - a[k]));
+		}
+		double sign = double(a[3])*b[3] + double(a[4])*b[4] + double(a[5])*b[5] + double(a[6])*b[6] < 0.0 ? -1.0 : 1.0;
+		double n = 0.0;
+		for(int k = 3; k < 7; ++k) {
+			out[k] = float((1.0 - f)*a[k] + f*sign*b[k]);
+			n += double(out[k])*out[k];
+		}
+		n = sqrt(n);
+		for(int k = 3; k < 7 && n > 0.0; ++k) {
+			out[k] = float(out[k]/n);
+		}
+	}
+
+	SPoseRates m_rates;
+	double m_position[3];         //filtered position
+	float m_orientation[4];       //last orientation (x, y, z, w)
+	double m_time;                //time of the last sample
+	int m_samples;                //samples since the last restart
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
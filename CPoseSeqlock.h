@@ -0,0 +1,77 @@
+//Seqlock used to hand the latest pose of a sensor from the read thread (threadMe)
+//to the Vizard thread (UpdateSensor) without a mutex.
+//
+//There is exactly one writer. It never waits: publish() bumps the sequence to an
+//odd value, copies the snapshot and bumps it back to even. Readers copy the
+//snapshot and retry if the sequence was odd or changed underneath them, so they
+//always see a pose from a single OWL frame (no torn x from one frame, q from another).
+//
+//The lock is padded on both sides to a cache line so the writer's stores do not
+//false-share with whatever the owning struct keeps next to it.
+
+#ifndef CPoseSeqlockH
+#define CPoseSeqlockH
+
+#include <string.h>
+#include <boost/atomic.hpp>
+
+#include "CPosePredictor.h"
+
+const int POSE_CACHE_LINE = 64;
+
+//the state published for each sensor
+struct SPoseSnapshot {
+	float pose[7];                //position and quaternion in Vizard order (sensor data[0..6])
+	int samples;                  //the number of good samples taken so far
+	double arrival;               //clock time the OWL frame reached the read thread
+	SPoseRates rates;             //motion at that time, for prediction (zero unless predicting)
+};
+
+class cPoseSeqlock {
+public:
+
+	cPoseSeqlock() : m_sequence(0) {
+		memset(&m_snapshot, 0, sizeof(m_snapshot));
+	}
+
+	//Writer side, only call from one thread.
+	void publish(const SPoseSnapshot& s) {
+		unsigned int seq = m_sequence.load(boost::memory_order_relaxed);
+		m_sequence.store(seq + 1, boost::memory_order_relaxed);
+		boost::atomic_thread_fence(boost::memory_order_release);
+		memcpy(&m_snapshot, &s, sizeof(SPoseSnapshot));
+		m_sequence.store(seq + 2, boost::memory_order_release);
+	}
+
+	//Reader side, safe from any thread and never blocks the writer.
+	//Returns the generation (number of publishes) that was read.
+	unsigned int read(SPoseSnapshot& s) const {
+		unsigned int before, after;
+		do {
+			before = m_sequence.load(boost::memory_order_acquire);
+			memcpy(&s, &m_snapshot, sizeof(SPoseSnapshot));
+			boost::atomic_thread_fence(boost::memory_order_acquire);
+			after = m_sequence.load(boost::memory_order_relaxed);
+		} while((before & 1) != 0 || before != after);
+		return before >> 1;
+	}
+
+	//Number of publishes so far (cheap, no snapshot copy).
+	unsigned int generation() const {
+		return m_sequence.load(boost::memory_order_acquire) >> 1;
+	}
+
+private:
+	//not copyable (the sequence is shared state)
+	cPoseSeqlock(const cPoseSeqlock&);
+	cPoseSeqlock& operator=(const cPoseSeqlock&);
+
+	char m_padFront[POSE_CACHE_LINE];
+	boost::atomic<unsigned int> m_sequence;
+	SPoseSnapshot m_snapshot;
+	char m_padBack[POSE_CACHE_LINE];
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,317 @@
+//Batched mapping of OWL poses into Vizard coordinates.
+//
+//Every sensor has its own affine calibration (3x4, row major):
+//   position     p_viz = A * p_owl + b
+//   orientation  q_viz = q_cal * mirror(q_owl)
+//mirror() is the fixed handedness change between PhaseSpace and Vizard (x flips),
+//q_cal is the rotation left in A once the mirror and any scale are taken out
+//(identity for the default calibration).
+//
+//The default calibration reproduces the original global behaviour:
+//   A = diag(-SCALE_X, SCALE_Y, SCALE_Z),  b = (-SCALE_X*OFFSET_X, SCALE_Y*OFFSET_Y, SCALE_Z*OFFSET_Z)
+//
+//Everything is stored as structure of arrays so a whole frame of sensors goes
+//through one loop; the loop is written once against a small lane type and
+//instantiated for AVX (8 sensors), SSE (4) and plain floats (the remainder, or
+//everything on compilers without SSE).
+//
+//Input per slot:  OWL pose x, y, z, qw, qx, qy, qz (OWLRigid::pose layout)
+//Output per slot: Vizard x, y, z, qx, qy, qz, qw (sensor data[0..6] layout)
+
+#ifndef CPoseTransformH
+#define CPoseTransformH
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define POSE_TRANSFORM_SSE
+#endif
+
+//rows of the SoA input/output arrays
+enum EPoseIn { POSE_IN_X = 0, POSE_IN_Y, POSE_IN_Z, POSE_IN_QW, POSE_IN_QX, POSE_IN_QY, POSE_IN_QZ, POSE_IN_COUNT };
+enum EPoseOut { POSE_OUT_X = 0, POSE_OUT_Y, POSE_OUT_Z, POSE_OUT_QX, POSE_OUT_QY, POSE_OUT_QZ, POSE_OUT_QW, POSE_OUT_COUNT };
+
+//rows of the SoA calibration: the 3x4 matrix then q_cal
+enum EPoseCal { POSE_CAL_M00 = 0, POSE_CAL_M23 = 11, POSE_CAL_QW = 12, POSE_CAL_QX, POSE_CAL_QY, POSE_CAL_QZ, POSE_CAL_COUNT };
+
+//lane types for the kernel
+struct SScalarLanes {
+	typedef float V;
+	enum { WIDTH = 1 };
+	static V load(const float* p) { return *p; }
+	static void store(float* p, const V& v) { *p = v; }
+	static V add(const V& a, const V& b) { return a + b; }
+	static V sub(const V& a, const V& b) { return a - b; }
+	static V mul(const V& a, const V& b) { return a * b; }
+	static V neg(const V& a) { return -a; }
+};
+#if defined(POSE_TRANSFORM_SSE)
+struct SSseLanes {
+	typedef __m128 V;
+	enum { WIDTH = 4 };
+	static V load(const float* p) { return _mm_load_ps(p); }
+	static void store(float* p, const V& v) { _mm_store_ps(p, v); }
+	static V add(const V& a, const V& b) { return _mm_add_ps(a, b); }
+	static V sub(const V& a, const V& b) { return _mm_sub_ps(a, b); }
+	static V mul(const V& a, const V& b) { return _mm_mul_ps(a, b); }
+	static V neg(const V& a) { return _mm_sub_ps(_mm_setzero_ps(), a); }
+};
+#endif
+#if defined(__AVX__)
+struct SAvxLanes {
+	typedef __m256 V;
+	enum { WIDTH = 8 };
+	static V load(const float* p) { return _mm256_load_ps(p); }
+	static void store(float* p, const V& v) { _mm256_store_ps(p, v); }
+	static V add(const V& a, const V& b) { return _mm256_add_ps(a, b); }
+	static V sub(const V& a, const V& b) { return _mm256_sub_ps(a, b); }
+	static V mul(const V& a, const V& b) { return _mm256_mul_ps(a, b); }
+	static V neg(const V& a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+};
+#endif
+
+class cPoseTransformBatch {
+public:
+
+	cPoseTransformBatch() : m_storage(NULL), m_capacity(0), m_count(0) {}
+
+	~cPoseTransformBatch() {
+		delete[] m_storage;
+	}
+
+	//Make room for count slots. New slots get the identity calibration.
+	//Not for the hot path (allocates when growing).
+	void resize(const int& count) {
+		if(count > m_capacity) {
+			int capacity = (count + 7) & ~7;
+			int rows = POSE_IN_COUNT + POSE_OUT_COUNT + POSE_CAL_COUNT;
+			float* storage = new float[rows*capacity + 8];
+			float* base = align(storage);
+			memset(base, 0, sizeof(float)*rows*capacity);
+			for(int r = 0; r < rows; ++r) {
+				m_rows[r] = base + r*capacity;
+			}
+			for(int i = 0; i < capacity; ++i) {
+				setIdentity(i);
+			}
+			delete[] m_storage;
+			m_storage = storage;
+			m_capacity = capacity;
+		}
+		m_count = count;
+	}
+
+	int size() const {
+		return m_count;
+	}
+
+	//the default (global) calibration
+	static void defaultCalibration(float m[12], const float scale[3], const float offset[3]) {
+		memset(m, 0, 12*sizeof(float));
+		m[0] = -scale[0];  m[3] = -scale[0]*offset[0];
+		m[5] = scale[1];   m[7] = scale[1]*offset[1];
+		m[10] = scale[2];  m[11] = scale[2]*offset[2];
+	}
+
+	//Set a slot's 3x4 row major calibration.
+	//Returns false if the linear part does not keep the PhaseSpace handedness change
+	//(the orientation then only gets the mirror).
+	bool setCalibration(const int& slot, const float m[12]) {
+		for(int k = 0; k < 12; ++k) {
+			m_rows[CAL_ROW + POSE_CAL_M00 + k][slot] = m[k];
+		}
+		float q[4];
+		bool ok = rotationOf(m, q);
+		m_rows[CAL_ROW + POSE_CAL_QW][slot] = q[0];
+		m_rows[CAL_ROW + POSE_CAL_QX][slot] = q[1];
+		m_rows[CAL_ROW + POSE_CAL_QY][slot] = q[2];
+		m_rows[CAL_ROW + POSE_CAL_QZ][slot] = q[3];
+		return ok;
+	}
+
+	//input pose of a slot (OWL layout, 7 floats)
+	void setInput(const int& slot, const float pose[7]) {
+		for(int k = 0; k < POSE_IN_COUNT; ++k) {
+			m_rows[k][slot] = pose[k];
+		}
+	}
+
+	//input position only (point markers), orientation is identity
+	void setInput(const int& slot, const float& x, const float& y, const float& z) {
+		m_rows[POSE_IN_X][slot] = x;
+		m_rows[POSE_IN_Y][slot] = y;
+		m_rows[POSE_IN_Z][slot] = z;
+		m_rows[POSE_IN_QW][slot] = 1.0f;
+		m_rows[POSE_IN_QX][slot] = 0.0f;
+		m_rows[POSE_IN_QY][slot] = 0.0f;
+		m_rows[POSE_IN_QZ][slot] = 0.0f;
+	}
+
+	//output pose of a slot (Vizard data layout, 7 floats)
+	void getOutput(const int& slot, float out[7]) const {
+		for(int k = 0; k < POSE_OUT_COUNT; ++k) {
+			out[k] = m_rows[OUT_ROW + k][slot];
+		}
+	}
+
+	//an OWL direction through a slot's linear part (no offset), one slot at a time
+	void mapDirection(const int& slot, const float in[3], float out[3]) const {
+		for(int r = 0; r < 3; ++r) {
+			int row = CAL_ROW + POSE_CAL_M00 + 4*r;
+			out[r] = m_rows[row][slot]*in[0] + m_rows[row + 1][slot]*in[1] + m_rows[row + 2][slot]*in[2];
+		}
+	}
+
+	//Transform every slot, with lanes no wider than maxWidth (narrower kernels are the
+	//reference the wider ones are checked against, tests/transform_check.cpp).
+	void apply(const int& maxWidth = 8) {
+		int i = 0;
+#if defined(__AVX__)
+		if(maxWidth >= SAvxLanes::WIDTH) {
+			i = run<SAvxLanes>(i);
+		}
+#endif
+#if defined(POSE_TRANSFORM_SSE)
+		if(maxWidth >= SSseLanes::WIDTH) {
+			i = run<SSseLanes>(i);
+		}
+#endif
+		run<SScalarLanes>(i);
+	}
+
+	//widest lane type apply() uses (8 AVX, 4 SSE, 1 scalar)
+	static int laneWidth() {
+#if defined(__AVX__)
+		return SAvxLanes::WIDTH;
+#elif defined(POSE_TRANSFORM_SSE)
+		return SSseLanes::WIDTH;
+#else
+		return SScalarLanes::WIDTH;
+#endif
+	}
+
+private:
+	//not copyable
+	cPoseTransformBatch(const cPoseTransformBatch&);
+	cPoseTransformBatch& operator=(const cPoseTransformBatch&);
+
+	enum { OUT_ROW = POSE_IN_COUNT, CAL_ROW = POSE_IN_COUNT + POSE_OUT_COUNT };
+
+	static float* align(float* p) {
+		size_t address = (size_t)p;
+		return (float*)((address + 31) & ~size_t(31));
+	}
+
+	void setIdentity(const int& slot) {
+		float m[12] = {-1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+		setCalibration(slot, m);
+	}
+
+	//Rotation left in A once the x mirror and the column scales are removed.
+	//q is (w, x, y, z); identity and false if that is not a proper rotation.
+	static bool rotationOf(const float m[12], float q[4]) {
+		//R = A * diag(-1, 1, 1), then normalize the columns
+		float r[3][3];
+		for(int row = 0; row < 3; ++row) {
+			r[row][0] = -m[4*row + 0];
+			r[row][1] = m[4*row + 1];
+			r[row][2] = m[4*row + 2];
+		}
+		for(int col = 0; col < 3; ++col) {
+			float n = sqrtf(r[0][col]*r[0][col] + r[1][col]*r[1][col] + r[2][col]*r[2][col]);
+			if(n <= 0.0f) {
+				q[0] = 1.0f; q[1] = q[2] = q[3] = 0.0f;
+				return false;
+			}
+			for(int row = 0; row < 3; ++row) {
+				r[row][col] /= n;
+			}
+		}
+		float det = r[0][0]*(r[1][1]*r[2][2] - r[1][2]*r[2][1])
+			- r[0][1]*(r[1][0]*r[2][2] - r[1][2]*r[2][0])
+			+ r[0][2]*(r[1][0]*r[2][1] - r[1][1]*r[2][0]);
+		if(det <= 0.0f) {
+			q[0] = 1.0f; q[1] = q[2] = q[3] = 0.0f;
+			return false;
+		}
+		//standard matrix to quaternion (largest diagonal first for stability)
+		float trace = r[0][0] + r[1][1] + r[2][2];
+		if(trace > 0.0f) {
+			float s = 2.0f*sqrtf(trace + 1.0f);
+			q[0] = 0.25f*s;
+			q[1] = (r[2][1] - r[1][2])/s;
+			q[2] = (r[0][2] - r[2][0])/s;
+			q[3] = (r[1][0] - r[0][1])/s;
+		} else if(r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+			float s = 2.0f*sqrtf(1.0f + r[0][0] - r[1][1] - r[2][2]);
+			q[0] = (r[2][1] - r[1][2])/s;
+			q[1] = 0.25f*s;
+			q[2] = (r[0][1] + r[1][0])/s;
+			q[3] = (r[0][2] + r[2][0])/s;
+		} else if(r[1][1] > r[2][2]) {
+			float s = 2.0f*sqrtf(1.0f + r[1][1] - r[0][0] - r[2][2]);
+			q[0] = (r[0][2] - r[2][0])/s;
+			q[1] = (r[0][1] + r[1][0])/s;
+			q[2] = 0.25f*s;
+			q[3] = (r[1][2] + r[2][1])/s;
+		} else {
+			float s = 2.0f*sqrtf(1.0f + r[2][2] - r[0][0] - r[1][1]);
+			q[0] = (r[1][0] - r[0][1])/s;
+			q[1] = (r[0][2] + r[2][0])/s;
+			q[2] = (r[1][2] + r[2][1])/s;
+			q[3] = 0.25f*s;
+		}
+		return true;
+	}
+
+	//The kernel, returns the first slot it did not do.
+	template <class L>
+	int run(int i) {
+		typedef typename L::V V;
+		float** in = m_rows;
+		float** out = m_rows + OUT_ROW;
+		float** cal = m_rows + CAL_ROW;
+		for(; i + int(L::WIDTH) <= m_count; i += L::WIDTH) {
+			V x = L::load(in[POSE_IN_X] + i);
+			V y = L::load(in[POSE_IN_Y] + i);
+			V z = L::load(in[POSE_IN_Z] + i);
+
+			//position
+			L::store(out[POSE_OUT_X] + i, L::add(L::add(L::mul(L::load(cal[0] + i), x), L::mul(L::load(cal[1] + i), y)),
+				L::add(L::mul(L::load(cal[2] + i), z), L::load(cal[3] + i))));
+			L::store(out[POSE_OUT_Y] + i, L::add(L::add(L::mul(L::load(cal[4] + i), x), L::mul(L::load(cal[5] + i), y)),
+				L::add(L::mul(L::load(cal[6] + i), z), L::load(cal[7] + i))));
+			L::store(out[POSE_OUT_Z] + i, L::add(L::add(L::mul(L::load(cal[8] + i), x), L::mul(L::load(cal[9] + i), y)),
+				L::add(L::mul(L::load(cal[10] + i), z), L::load(cal[11] + i))));
+
+			//orientation: mirror (w, x, y, z) -> (-w, -x, y, z), then q_cal * q
+			V w = L::neg(L::load(in[POSE_IN_QW] + i));
+			V a = L::neg(L::load(in[POSE_IN_QX] + i));
+			V b = L::load(in[POSE_IN_QY] + i);
+			V c = L::load(in[POSE_IN_QZ] + i);
+			V cw = L::load(cal[POSE_CAL_QW] + i);
+			V cx = L::load(cal[POSE_CAL_QX] + i);
+			V cy = L::load(cal[POSE_CAL_QY] + i);
+			V cz = L::load(cal[POSE_CAL_QZ] + i);
+			L::store(out[POSE_OUT_QW] + i, L::sub(L::sub(L::mul(cw, w), L::mul(cx, a)), L::add(L::mul(cy, b), L::mul(cz, c))));
+			L::store(out[POSE_OUT_QX] + i, L::add(L::add(L::mul(cw, a), L::mul(cx, w)), L::sub(L::mul(cy, c), L::mul(cz, b))));
+			L::store(out[POSE_OUT_QY] + i, L::add(L::sub(L::mul(cw, b), L::mul(cx, c)), L::add(L::mul(cy, w), L::mul(cz, a))));
+			L::store(out[POSE_OUT_QZ] + i, L::add(L::add(L::mul(cw, c), L::mul(cx, b)), L::sub(L::mul(cz, w), L::mul(cy, a))));
+		}
+		return i;
+	}
+
+	float* m_storage;
+	float* m_rows[POSE_IN_COUNT + POSE_OUT_COUNT + POSE_CAL_COUNT];
+	int m_capacity;     //slots allocated (multiple of 8, rows are 32 byte aligned)
+	int m_count;        //slots in use
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
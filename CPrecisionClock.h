@@ -7,38 +7,200 @@
 //
 //Joe Snider 3/12 - Gah ... boost is only giving 1ms resolution on some machines.
 //  back to queryperformance (but check it)
-
-#include <windows.h>
+//
+//10/26 - Portable, and reads are 64 bit integer ticks converted to seconds only when
+//  needed (so one read can be shared, e.g. by every sensor of an OWL frame):
+//     Windows     QueryPerformanceCounter
+//     elsewhere   clock_gettime(CLOCK_MONOTONIC_RAW), CLOCK_MONOTONIC if there is no raw clock
+//     TSC         define PRECISION_CLOCK_TSC to read the time stamp counter directly on x86
+//                 when the cpu says it is invariant; it is calibrated against the clock
+//                 above when constructed (a few ms), otherwise that clock is used
+//  measure() gives the read cost and resolution of whichever source is in use.
 
 #ifndef CPrecisionClockH
 #define CPrecisionClockH
 
+#include <boost/cstdint.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(PRECISION_CLOCK_TSC)
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PRECISION_CLOCK_HAS_TSC
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#include <cpuid.h>
+#define PRECISION_CLOCK_HAS_TSC
+#endif
+#endif
+
 using namespace std;
 
+typedef boost::int64_t tClockTicks;
+
+enum EClockSource {
+	CLOCK_SOURCE_QPC = 0,
+	CLOCK_SOURCE_MONOTONIC_RAW = 1,
+	CLOCK_SOURCE_MONOTONIC = 2,
+	CLOCK_SOURCE_TSC = 3
+};
+
 class cPrecisionClock {
 public:
 
 	// Constructor of cPrecisionClock.
-	cPrecisionClock() {
-		QueryPerformanceFrequency(&m_li);
-		m_invFreq = 1.0/double(m_li.QuadPart);
+	cPrecisionClock() : m_useTsc(false) {
+		m_frequency = osFrequency();
+#if defined(PRECISION_CLOCK_HAS_TSC)
+		if(invariantTsc()) {
+			calibrateTsc();
+		}
+#endif
+		m_invFreq = 1.0/m_frequency;
 		//get the current time
-		QueryPerformanceCounter(&m_zeroTime);
+		m_zeroTime = ticks();
 	}
 
 	//! Destructor of cPrecisionClock.
 	~cPrecisionClock() {}
 
+	//the current time in ticks (1/frequency() seconds each)
+	tClockTicks ticks() const {
+#if defined(PRECISION_CLOCK_HAS_TSC)
+		if(m_useTsc) {
+			return tClockTicks(__rdtsc());
+		}
+#endif
+		return osTicks();
+	}
+
+	//seconds since the clock was made for a tick reading
+	double seconds(const tClockTicks& t) const {
+		return double(t - m_zeroTime)*m_invFreq;
+	}
+
+	//seconds between two tick readings
+	double elapsed(const tClockTicks& from, const tClockTicks& to) const {
+		return double(to - from)*m_invFreq;
+	}
+
 	//compatibility with the old robot code
-	double getCPUTimeSeconds() {
-		QueryPerformanceCounter(&m_li);
-		return double(m_li.QuadPart - m_zeroTime.QuadPart)*m_invFreq;
+	double getCPUTimeSeconds() const {
+		return seconds(ticks());
+	}
+
+	double frequency() const {
+		return m_frequency;
+	}
+
+	int source() const {
+		if(m_useTsc) {
+			return CLOCK_SOURCE_TSC;
+		}
+#if defined(_WIN32)
+		return CLOCK_SOURCE_QPC;
+#elif defined(CLOCK_MONOTONIC_RAW)
+		return CLOCK_SOURCE_MONOTONIC_RAW;
+#else
+		return CLOCK_SOURCE_MONOTONIC;
+#endif
+	}
+
+	const char* sourceName() const {
+		static const char* names[] = {"QueryPerformanceCounter", "CLOCK_MONOTONIC_RAW", "CLOCK_MONOTONIC", "TSC"};
+		return names[source()];
+	}
+
+	//Time reads back to back: cost is the mean seconds per read, resolution the
+	//smallest step seen between two reads that differ (seconds).
+	void measure(const int& reads, double& cost, double& resolution) const {
+		tClockTicks smallest = 0;
+		tClockTicks start = ticks();
+		tClockTicks last = start;
+		for(int i = 0; i < reads; ++i) {
+			tClockTicks t = ticks();
+			if(t != last && (smallest == 0 || t - last < smallest)) {
+				smallest = t - last;
+			}
+			last = t;
+		}
+		cost = reads > 0 ? elapsed(start, last)/double(reads) : 0.0;
+		resolution = double(smallest)*m_invFreq;
 	}
 
 private:
+	static tClockTicks osTicks() {
+#if defined(_WIN32)
+		LARGE_INTEGER li;
+		QueryPerformanceCounter(&li);
+		return tClockTicks(li.QuadPart);
+#else
+		timespec now;
+#if defined(CLOCK_MONOTONIC_RAW)
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+#else
+		clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+		return tClockTicks(now.tv_sec)*1000000000 + tClockTicks(now.tv_nsec);
+#endif
+	}
+
+	static double osFrequency() {
+#if defined(_WIN32)
+		LARGE_INTEGER li;
+		QueryPerformanceFrequency(&li);
+		return double(li.QuadPart);
+#else
+		return 1.0e9;
+#endif
+	}
+
+#if defined(PRECISION_CLOCK_HAS_TSC)
+	//cpuid 0x80000007, edx bit 8: the TSC runs at a constant rate in every power state
+	static bool invariantTsc() {
+#if defined(_MSC_VER)
+		int regs[4];
+		__cpuid(regs, 0x80000000);
+		if((unsigned int)regs[0] < 0x80000007u) {
+			return false;
+		}
+		__cpuid(regs, 0x80000007);
+		return (regs[3] & (1 << 8)) != 0;
+#else
+		unsigned int a, b, c, d;
+		if(__get_cpuid_max(0x80000000, NULL) < 0x80000007u || !__get_cpuid(0x80000007, &a, &b, &c, &d)) {
+			return false;
+		}
+		return (d & (1u << 8)) != 0;
+#endif
+	}
+
+	//TSC rate against the OS clock over ~10 ms
+	void calibrateTsc() {
+		tClockTicks os0 = osTicks();
+		tClockTicks tsc0 = tClockTicks(__rdtsc());
+		tClockTicks os1, tsc1;
+		do {
+			os1 = osTicks();
+			tsc1 = tClockTicks(__rdtsc());
+		} while(double(os1 - os0) < 0.01*m_frequency);
+		double rate = double(tsc1 - tsc0)/(double(os1 - os0)/m_frequency);
+		if(rate > 0.0) {
+			m_frequency = rate;
+			m_useTsc = true;
+		}
+	}
+#endif
+
+	bool m_useTsc;
+	double m_frequency;
 	double m_invFreq;
-	LARGE_INTEGER m_li;
-	LARGE_INTEGER m_zeroTime;
+	tClockTicks m_zeroTime;
 };
 
 //---------------------------------------------------------------------------
@@ -0,0 +1,214 @@
+//Wait strategies for the OWL read thread (threadMe).
+//
+//owlGetMarkers/owlGetRigids do not block, so the read thread has to decide what to
+//do when a poll comes back empty:
+//   READ_WAIT_SPIN         poll again right away (lowest latency, burns a full core)
+//   READ_WAIT_SPIN_YIELD   spin a little, then give the rest of the time slice away
+//   READ_WAIT_FRAME_SLEEP  sleep until shortly before the next expected frame
+//                          (from LOCAL_OWL_FREQUENCY), then spin/yield
+//
+//Each mode keeps its own statistics so they can be compared on the lab machines:
+//cpu use of the read thread and the frame pickup latency, i.e. the time between
+//the last empty poll and the poll that found the frame (an upper bound on how long
+//a frame sat in OWL before we read it).
+//
+//Only the read thread touches this object.
+
+#ifndef CReadWaitH
+#define CReadWaitH
+
+#include <iostream>
+#include <boost/thread.hpp>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "winmm.lib")
+#endif
+#else
+#include <time.h>
+#endif
+
+enum EReadWaitMode {
+	READ_WAIT_SPIN = 0,
+	READ_WAIT_SPIN_YIELD = 1,
+	READ_WAIT_FRAME_SLEEP = 2,
+	READ_WAIT_MODE_COUNT = 3
+};
+
+//cpu time used by the calling thread
+inline double ThreadCpuSeconds() {
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if(!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+		return 0.0;
+	}
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	return double(k.QuadPart + u.QuadPart)*1.0e-7;
+#else
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return double(t.tv_sec) + 1.0e-9*double(t.tv_nsec);
+#endif
+}
+
+class cReadWait {
+public:
+
+	cReadWait() : m_mode(READ_WAIT_SPIN), m_period(1.0/960.0), m_margin(0.001),
+		m_spinLimit(200), m_emptyPolls(0), m_lastFrame(-1.0), m_lastPoll(-1.0),
+		m_timerRaised(false) {
+		for(int i = 0; i < READ_WAIT_MODE_COUNT; ++i) {
+			clearStats(m_stats[i]);
+		}
+	}
+
+	~cReadWait() {
+		setTimerResolution(false);
+	}
+
+	//Switch modes; frequency is the OWL rate in Hz, margin is how early (seconds)
+	//to wake before the next expected frame in READ_WAIT_FRAME_SLEEP.
+	void setMode(const int& mode, const float& frequency, const double& margin, const double& now) {
+		closeStats(now);
+		m_mode = (mode >= 0 && mode < READ_WAIT_MODE_COUNT) ? mode : READ_WAIT_SPIN;
+		m_period = frequency > 0.0f ? 1.0/double(frequency) : 1.0/960.0;
+		if(margin > 0.0) {
+			m_margin = margin;
+		}
+		m_emptyPolls = 0;
+		setTimerResolution(m_mode == READ_WAIT_FRAME_SLEEP);
+		openStats(now);
+	}
+
+	int mode() const {
+		return m_mode;
+	}
+
+	//Call after every poll of OWL, now is the clock time of the poll.
+	//Records the statistics and then waits according to the mode.
+	void afterPoll(const bool& gotFrame, const double& now) {
+		SStats& st = m_stats[m_mode];
+		if(st.wallStart < 0.0) {
+			openStats(now);
+		}
+		if(gotFrame) {
+			++st.frames;
+			if(m_lastPoll >= 0.0) {
+				double pickup = now - m_lastPoll;
+				st.pickupSum += pickup;
+				if(pickup > st.pickupMax) {
+					st.pickupMax = pickup;
+				}
+			}
+			m_lastFrame = now;
+			m_lastPoll = -1.0;
+			m_emptyPolls = 0;
+			return;
+		}
+
+		++st.emptyPolls;
+		++m_emptyPolls;
+		m_lastPoll = now;
+
+		switch(m_mode) {
+		case READ_WAIT_SPIN_YIELD:
+			if(m_emptyPolls > m_spinLimit) {
+				boost::this_thread::yield();
+			}
+			break;
+		case READ_WAIT_FRAME_SLEEP:
+			if(m_lastFrame >= 0.0) {
+				double remaining = m_lastFrame + m_period - m_margin - now;
+				if(remaining > 0.0) {
+					boost::this_thread::sleep(boost::posix_time::microseconds(long(remaining*1.0e6)));
+					break;
+				}
+			}
+			if(m_emptyPolls > m_spinLimit) {
+				boost::this_thread::yield();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	//Print the statistics for every mode that has been used.
+	void report(std::ostream& out, const double& now) {
+		closeStats(now);
+		static const char* names[READ_WAIT_MODE_COUNT] = {"spin", "spin-then-yield", "frame-period sleep"};
+		out << "PhaseSpace read thread wait statistics (current mode: " << names[m_mode] << ")\n";
+		for(int i = 0; i < READ_WAIT_MODE_COUNT; ++i) {
+			const SStats& st = m_stats[i];
+			if(st.wall <= 0.0) {
+				continue;
+			}
+			out << "   " << names[i] << ": " << st.wall << " s, cpu " << 100.0*st.cpu/st.wall << "%, "
+				<< st.frames << " frames (" << double(st.frames)/st.wall << " Hz), "
+				<< (st.frames > 0 ? double(st.emptyPolls)/double(st.frames) : 0.0) << " empty polls/frame, pickup latency mean "
+				<< (st.frames > 0 ? 1.0e6*st.pickupSum/double(st.frames) : 0.0) << " us max "
+				<< 1.0e6*st.pickupMax << " us\n";
+		}
+		out << std::flush;
+		openStats(now);
+	}
+
+private:
+	struct SStats {
+		double wallStart, cpuStart;   //start of the current stretch in this mode (-1 if none)
+		double wall, cpu;             //accumulated wall and thread cpu time
+		long frames, emptyPolls;
+		double pickupSum, pickupMax;
+	};
+
+	void clearStats(SStats& st) {
+		st.wallStart = -1.0; st.cpuStart = 0.0;
+		st.wall = 0.0; st.cpu = 0.0;
+		st.frames = 0; st.emptyPolls = 0;
+		st.pickupSum = 0.0; st.pickupMax = 0.0;
+	}
+
+	void openStats(const double& now) {
+		m_stats[m_mode].wallStart = now;
+		m_stats[m_mode].cpuStart = ThreadCpuSeconds();
+	}
+
+	void closeStats(const double& now) {
+		SStats& st = m_stats[m_mode];
+		if(st.wallStart >= 0.0) {
+			st.wall += now - st.wallStart;
+			st.cpu += ThreadCpuSeconds() - st.cpuStart;
+			st.wallStart = -1.0;
+		}
+	}
+
+	//sub-millisecond sleeps need the 1 ms system timer on windows
+	void setTimerResolution(const bool& raise) {
+#if defined(_WIN32)
+		if(raise && !m_timerRaised) {
+			timeBeginPeriod(1);
+		} else if(!raise && m_timerRaised) {
+			timeEndPeriod(1);
+		}
+#endif
+		m_timerRaised = raise;
+	}
+
+	int m_mode;
+	double m_period;
+	double m_margin;
+	long m_spinLimit;          //empty polls before yielding
+	long m_emptyPolls;         //empty polls since the last frame
+	double m_lastFrame;        //time of the last frame (-1 if none yet)
+	double m_lastPoll;         //time of the last empty poll since the last frame (-1 if none)
+	bool m_timerRaised;
+	SStats m_stats[READ_WAIT_MODE_COUNT];
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
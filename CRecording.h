@@ -0,0 +1,167 @@
+//Samples recorded by the PhaseSpace plugin and how they are written to disk.
+//
+//Two file formats:
+//   text     one line per sample: time ttl x y z [qx qy qz qw] (the original dump)
+//   binary   versioned, fixed stride, little endian, meant to be mapped straight
+//            into memory (see CRecordingReader.h):
+//               SRecordFileHeader
+//               int   markers[markerCount]
+//               float rigidDefinition[markerCount][3]   (only if hasRigidDefinition)
+//               zero padding up to headerSize
+//               SRecordSample samples[sampleCount]      (sampleSize bytes apart)
+//            sampleCount is patched in when the file is finished; readers should
+//            trust the file size if it is 0 (e.g. the plugin died while streaming).
+//
+//What ttl and flags hold, by binary version (the layout is the same in both):
+//   1   ttl is ttl_0 alone (0 or 1). flags is 0, except that builds with marker gap
+//       filling (command 25) set RECORD_FLAG_FILLED and RECORD_FLAG_EXTRAPOLATED.
+//       Point markers have 1 0 0 0 in the orientation fields, ignore it (isRigid 0)
+//   2   ttl is the four TTL inputs as bits, ttl_0 lowest (ttl & 1 is the old value),
+//       flags is any of ERecordFlags, including the TTL window flags (command 35)
+//Text files carry no version: their ttl is ttl_0 alone from builds before the TTL
+//windows and the four bits since, so ttl & 1 is ttl_0 in both.
+
+#ifndef CRecordingH
+#define CRecordingH
+
+#include <ostream>
+#include <vector>
+#include <stddef.h>
+#include <string.h>
+#include <boost/cstdint.hpp>
+
+//one recorded sample of a sensor
+struct dataRecordMember {
+	double time;                      //seconds on the Vizard clock (float lost ms after a few hours)
+	float x, y, z;
+	int ttl;                          //the four TTL inputs as bits, ttl_0 lowest
+	float qx, qy, qz, qw;             //Vizard order, as sensor data[3..6]
+	unsigned int flags;               //ERecordFlags
+};
+
+//what the plugin did to a sample (SRecordSample::flags, binary files only)
+enum ERecordFlags {
+	RECORD_FLAG_FILLED = 1,           //built with markers that were filled in (CMarkerGapFill.h)
+	RECORD_FLAG_EXTRAPOLATED = 2,     //some of them were carried on from earlier frames
+	RECORD_FLAG_WINDOW = 4,           //kept in a window around a TTL edge (CTtlWindow.h)
+	RECORD_FLAG_TRIGGER = 8,          //the sample with the edge
+	RECORD_FLAG_BASELINE = 16         //kept outside the windows by the baseline decimation
+};
+
+//Write one sample as a line of text: time ttl x y z [qx qy qz qw]
+//(the orientation is only written for rigids, in Vizard order as sensor data[3..6]).
+inline void WriteRecordText(std::ostream& out, const dataRecordMember& r, const bool& withOrientation) {
+	out << r.time << " "
+		<< r.ttl << " "
+		<< r.x << " "
+		<< r.y << " "
+		<< r.z;
+	if(withOrientation) {
+		out << " " << r.qx << " "
+			<< r.qy << " "
+			<< r.qz << " "
+			<< r.qw;
+	}
+	out << "\n";
+}
+
+//---------------------------------------------------------------------------
+// binary format
+//---------------------------------------------------------------------------
+const char RECORD_FILE_MAGIC[8] = {'P', 'S', 'R', 'E', 'C', 'B', 'I', 'N'};
+const boost::uint32_t RECORD_FILE_VERSION = 2;    //see the top of the file for the history
+
+//fixed part of the file header (all sizes in bytes)
+struct SRecordFileHeader {
+	char magic[8];                    //RECORD_FILE_MAGIC
+	boost::uint32_t version;          //RECORD_FILE_VERSION
+	boost::uint32_t headerSize;       //offset of the first sample (multiple of 8)
+	boost::uint32_t sampleSize;       //stride between samples
+	boost::int32_t sensorId;          //order of creation in the plugin
+	boost::int32_t trackerId;
+	boost::int32_t isRigid;           //1 if the samples carry an orientation
+	boost::int32_t markerCount;       //entries in the marker list that follows
+	boost::int32_t hasRigidDefinition;
+	float scale[3];                   //SCALE_X/Y/Z when the recording started
+	float offset[3];                  //OFFSET_X/Y/Z when the recording started
+	float frequency;                  //OWL sample frequency (Hz)
+	boost::int32_t reserved;
+	double timeOffset;                //clock to Vizard tick offset (already added to sample times)
+	boost::uint64_t sampleCount;      //0 until the file is finished
+	char server[64];                  //OWL server address
+};
+
+//one sample as stored in the binary file
+struct SRecordSample {
+	double time;                      //seconds on the Vizard clock
+	boost::int32_t ttl;               //TTL inputs as bits, ttl_0 lowest (ttl_0 alone in version 1)
+	boost::uint32_t flags;            //ERecordFlags (only FILLED and EXTRAPOLATED in version 1)
+	float x, y, z;
+	float qx, qy, qz, qw;             //Vizard order (sensor data[3..6]), 0 0 0 1 for point markers
+	float reserved;
+};
+
+//Everything needed to write a binary header.
+struct SRecordFileInfo {
+	SRecordFileHeader header;
+	std::vector<boost::int32_t> markers;
+	std::vector<float> rigidDefinition;   //3 per marker or empty
+};
+
+inline void InitRecordFileHeader(SRecordFileHeader& h) {
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, RECORD_FILE_MAGIC, sizeof(h.magic));
+	h.version = RECORD_FILE_VERSION;
+	h.sampleSize = sizeof(SRecordSample);
+}
+
+//Write the header (fills in markerCount, hasRigidDefinition and headerSize).
+inline void WriteRecordFileHeader(std::ostream& out, SRecordFileInfo& info) {
+	SRecordFileHeader& h = info.header;
+	h.markerCount = boost::int32_t(info.markers.size());
+	h.hasRigidDefinition = info.rigidDefinition.size() == 3*info.markers.size() && !info.markers.empty() ? 1 : 0;
+	size_t size = sizeof(SRecordFileHeader) + sizeof(boost::int32_t)*info.markers.size();
+	if(h.hasRigidDefinition) {
+		size += sizeof(float)*info.rigidDefinition.size();
+	}
+	size_t padding = (8 - size % 8) % 8;
+	h.headerSize = boost::uint32_t(size + padding);
+	h.sampleCount = 0;
+
+	out.write((const char*)&h, sizeof(h));
+	if(!info.markers.empty()) {
+		out.write((const char*)&info.markers[0], sizeof(boost::int32_t)*info.markers.size());
+	}
+	if(h.hasRigidDefinition) {
+		out.write((const char*)&info.rigidDefinition[0], sizeof(float)*info.rigidDefinition.size());
+	}
+	const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	out.write(zeros, padding);
+}
+
+inline void WriteRecordBinary(std::ostream& out, const dataRecordMember& r, const bool& withOrientation) {
+	SRecordSample s;
+	s.time = r.time;
+	s.ttl = r.ttl;
+	s.flags = r.flags;
+	s.x = r.x; s.y = r.y; s.z = r.z;
+	if(withOrientation) {
+		s.qx = r.qx; s.qy = r.qy; s.qz = r.qz; s.qw = r.qw;
+	} else {
+		s.qx = 0.0f; s.qy = 0.0f; s.qz = 0.0f; s.qw = 1.0f;
+	}
+	s.reserved = 0.0f;
+	out.write((const char*)&s, sizeof(s));
+}
+
+//Patch the sample count into a finished file (out must be seekable).
+inline void FinishRecordFile(std::ostream& out, const boost::uint64_t& sampleCount) {
+	std::streampos end = out.tellp();
+	out.seekp(offsetof(SRecordFileHeader, sampleCount));
+	out.write((const char*)&sampleCount, sizeof(sampleCount));
+	out.seekp(end);
+}
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
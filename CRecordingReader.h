@@ -0,0 +1,198 @@
+//Read-only, zero-copy access to a binary recording (format in CRecording.h).
+//
+//The file is memory mapped and samples() points straight into the mapping, so
+//opening a multi-gigabyte recording costs nothing until the samples are touched.
+//
+//   cRecordingReader r;
+//   if(r.open("session.psr")) {
+//       SRecordSpan s = r.samples();
+//       for(size_t i = 0; i < s.size(); ++i) { ... s[i].x ... }
+//   }
+//
+//The span is only valid while the reader is open.
+//Files of versions 1 to RECORD_FILE_VERSION open, header().version says how to read
+//their ttl and flags; files from newer plugins do not.
+
+#ifndef CRecordingReaderH
+#define CRecordingReaderH
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "CRecording.h"
+
+//a view of contiguous samples that does not own them
+struct SRecordSpan {
+	const SRecordSample* data;
+	size_t count;
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	const SRecordSample* begin() const { return data; }
+	const SRecordSample* end() const { return data + count; }
+	const SRecordSample& operator[](const size_t& i) const { return data[i]; }
+};
+
+class cRecordingReader {
+public:
+
+	cRecordingReader() : m_base(NULL), m_size(0) {
+#if defined(_WIN32)
+		m_file = INVALID_HANDLE_VALUE;
+		m_mapping = NULL;
+#else
+		m_file = -1;
+#endif
+	}
+
+	~cRecordingReader() {
+		close();
+	}
+
+	//Map the file and check the header. Returns false (and stays closed) on any error.
+	bool open(const char* name) {
+		close();
+#if defined(_WIN32)
+		m_file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if(m_file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(m_file, &size) || size.QuadPart < LONGLONG(sizeof(SRecordFileHeader))) {
+			close();
+			return false;
+		}
+		m_size = size_t(size.QuadPart);
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if(m_mapping == NULL) {
+			close();
+			return false;
+		}
+		m_base = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		m_file = ::open(name, O_RDONLY);
+		if(m_file < 0) {
+			return false;
+		}
+		struct stat st;
+		if(fstat(m_file, &st) != 0 || st.st_size < off_t(sizeof(SRecordFileHeader))) {
+			close();
+			return false;
+		}
+		m_size = size_t(st.st_size);
+		void* p = mmap(NULL, m_size, PROT_READ, MAP_SHARED, m_file, 0);
+		m_base = p == MAP_FAILED ? NULL : (const char*)p;
+#endif
+		if(m_base == NULL || !validHeader()) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close() {
+#if defined(_WIN32)
+		if(m_base != NULL) {
+			UnmapViewOfFile(m_base);
+		}
+		if(m_mapping != NULL) {
+			CloseHandle(m_mapping);
+		}
+		if(m_file != INVALID_HANDLE_VALUE) {
+			CloseHandle(m_file);
+		}
+		m_mapping = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if(m_base != NULL) {
+			munmap((void*)m_base, m_size);
+		}
+		if(m_file >= 0) {
+			::close(m_file);
+		}
+		m_file = -1;
+#endif
+		m_base = NULL;
+		m_size = 0;
+	}
+
+	bool isOpen() const {
+		return m_base != NULL;
+	}
+
+	const SRecordFileHeader& header() const {
+		return *(const SRecordFileHeader*)m_base;
+	}
+
+	//marker ids, header().markerCount of them
+	const boost::int32_t* markers() const {
+		return (const boost::int32_t*)(m_base + sizeof(SRecordFileHeader));
+	}
+
+	//rigid body definition (x, y, z per marker) or NULL if the file has none
+	const float* rigidDefinition() const {
+		if(!header().hasRigidDefinition) {
+			return NULL;
+		}
+		return (const float*)(markers() + header().markerCount);
+	}
+
+	//All complete samples. Uses the file size if the recording was never finished.
+	SRecordSpan samples() const {
+		SRecordSpan s;
+		const SRecordFileHeader& h = header();
+		s.data = (const SRecordSample*)(m_base + h.headerSize);
+		s.count = (m_size - h.headerSize)/h.sampleSize;
+		if(h.sampleCount > 0 && h.sampleCount < s.count) {
+			s.count = size_t(h.sampleCount);
+		}
+		return s;
+	}
+
+private:
+	//not copyable (owns the mapping)
+	cRecordingReader(const cRecordingReader&);
+	cRecordingReader& operator=(const cRecordingReader&);
+
+	bool validHeader() const {
+		const SRecordFileHeader& h = header();
+		if(memcmp(h.magic, RECORD_FILE_MAGIC, sizeof(h.magic)) != 0) {
+			return false;
+		}
+		//files from newer plugins may mean something else by ttl and flags
+		if(h.version < 1 || h.version > RECORD_FILE_VERSION || h.headerSize > m_size || h.headerSize % 8 != 0 || h.markerCount < 0) {
+			return false;
+		}
+		//the sample stride must match this reader to hand out a plain array
+		if(h.sampleSize != sizeof(SRecordSample)) {
+			return false;
+		}
+		size_t needed = sizeof(SRecordFileHeader) + sizeof(boost::int32_t)*size_t(h.markerCount);
+		if(h.hasRigidDefinition) {
+			needed += 3*sizeof(float)*size_t(h.markerCount);
+		}
+		return needed <= h.headerSize;
+	}
+
+	const char* m_base;
+	size_t m_size;
+#if defined(_WIN32)
+	HANDLE m_file;
+	HANDLE m_mapping;
+#else
+	int m_file;
+#endif
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,111 @@
+//Rigid body definitions kept between runs, so a scene can start without holding every
+//object still while its markers are sampled (CreateRigidLocations).
+//
+//A text file, one definition per line:
+//   server markerCount marker... x y z (per marker, OWL units, first marker at 0 0 0)
+//keyed by the server and the marker list: the same markers on another server (or in
+//another order) are another entry. The file is rewritten whole on save(), lines that do
+//not parse are dropped on load().
+
+#ifndef CRigidCacheH
+#define CRigidCacheH
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+
+class cRigidCache {
+public:
+
+	//Read a cache file, replacing what is held. A missing file is an empty cache.
+	//Returns the number of definitions read.
+	int load(const std::string& name) {
+		m_entries.clear();
+		std::ifstream in(name.c_str());
+		std::string line;
+		while(std::getline(in, line)) {
+			std::istringstream fields(line);
+			std::string server;
+			int count = 0;
+			if(!(fields >> server >> count) || count <= 0) {
+				continue;
+			}
+			std::vector<int> markers(count);
+			std::vector<float> definition(3*count);
+			bool ok = true;
+			for(int i = 0; i < count && ok; ++i) {
+				ok = !!(fields >> markers[i]);
+			}
+			for(int i = 0; i < 3*count && ok; ++i) {
+				ok = !!(fields >> definition[i]);
+			}
+			if(ok) {
+				m_entries[key(server, markers)] = definition;
+			}
+		}
+		return int(m_entries.size());
+	}
+
+	//Write every definition, returns false if the file could not be written.
+	bool save(const std::string& name) const {
+		std::ofstream out(name.c_str());
+		if(!out.good()) {
+			return false;
+		}
+		out.precision(9);
+		for(std::map<std::string, std::vector<float> >::const_iterator i = m_entries.begin(); i != m_entries.end(); ++i) {
+			out << i->first;
+			for(size_t k = 0; k < i->second.size(); ++k) {
+				out << " " << i->second[k];
+			}
+			out << "\n";
+		}
+		return out.good();
+	}
+
+	//definition (3 floats per marker) for the markers on server, false if there is none
+	bool find(const std::string& server, const std::vector<int>& markers, std::vector<float>& definition) const {
+		std::map<std::string, std::vector<float> >::const_iterator i = m_entries.find(key(server, markers));
+		if(i == m_entries.end() || i->second.size() != 3*markers.size()) {
+			return false;
+		}
+		definition = i->second;
+		return true;
+	}
+
+	void store(const std::string& server, const std::vector<int>& markers, const std::vector<float>& definition) {
+		m_entries[key(server, markers)] = definition;
+	}
+
+	//returns true if there was a definition to forget
+	bool erase(const std::string& server, const std::vector<int>& markers) {
+		return m_entries.erase(key(server, markers)) > 0;
+	}
+
+	void clear() {
+		m_entries.clear();
+	}
+
+	int size() const {
+		return int(m_entries.size());
+	}
+
+private:
+	//the start of the file line: server markerCount marker...
+	static std::string key(const std::string& server, const std::vector<int>& markers) {
+		std::ostringstream k;
+		k << server << " " << markers.size();
+		for(size_t i = 0; i < markers.size(); ++i) {
+			k << " " << markers[i];
+		}
+		return k.str();
+	}
+
+	std::map<std::string, std::vector<float> > m_entries;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
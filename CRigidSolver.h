@@ -0,0 +1,214 @@
+//Rigid body pose from point markers, for sensors OWL cannot make a rigid tracker for
+//(e.g. a slave connection).
+//
+//The template is each marker's position in the body frame, taken the same way as an
+//OWL rigid definition (CreateRigidLocations: the first marker at the origin, axes
+//along OWL's). Each frame the pose that best maps the template onto the markers seen
+//is found by Horn's closed form (J. Opt. Soc. Am. A 4, 1987): weighted centroids, the
+//3x3 cross covariance, and the rotation as the eigenvector of the largest eigenvalue
+//of the 4x4 symmetric matrix built from it (Jacobi, in doubles). The result is in the
+//OWLRigid::pose layout (x, y, z, qw, qx, qy, qz), so it goes through the same mapping
+//to Vizard as an OWL rigid.
+//
+//Any three or more markers that are not in a line give a pose; weights come from the
+//caller (cond). The quaternion is kept in the hemisphere of the last solution so the
+//output does not flip sign between frames.
+
+#ifndef CRigidSolverH
+#define CRigidSolverH
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+class cRigidSolver {
+public:
+
+	cRigidSolver() : m_count(0) {
+		memset(m_last, 0, sizeof(m_last));
+		m_last[3] = 1.0f;
+	}
+
+	//count body frame points, x, y, z each
+	void setTemplate(const float* points, const int& count) {
+		m_count = count;
+		m_template.assign(points, points + 3*count);
+		memset(m_last, 0, sizeof(m_last));
+		m_last[3] = 1.0f;
+	}
+
+	int count() const {
+		return m_count;
+	}
+
+	//Fit the template to observed (3 floats per template point) with weights (0 for a
+	//marker not seen). Returns false, and leaves pose at the last solution, if fewer than
+	//3 markers are seen or they are in a line. rms is the weighted residual (OWL units).
+	bool solve(const float* observed, const float* weights, float pose[7], float& rms) {
+		memcpy(pose, m_last, sizeof(m_last));
+		rms = 0.0f;
+		double w = 0.0, ct[3] = {0.0, 0.0, 0.0}, co[3] = {0.0, 0.0, 0.0};
+		int seen = 0;
+		for(int i = 0; i < m_count; ++i) {
+			if(weights[i] <= 0.0f) {
+				continue;
+			}
+			++seen;
+			w += weights[i];
+			for(int k = 0; k < 3; ++k) {
+				ct[k] += weights[i]*m_template[3*i + k];
+				co[k] += weights[i]*observed[3*i + k];
+			}
+		}
+		if(seen < 3) {
+			return false;
+		}
+		for(int k = 0; k < 3; ++k) {
+			ct[k] /= w;
+			co[k] /= w;
+		}
+
+		//cross covariance s[a][b] = sum w (template_a)(observed_b), both centred
+		double s[3][3] = {{0.0}};
+		for(int i = 0; i < m_count; ++i) {
+			if(weights[i] <= 0.0f) {
+				continue;
+			}
+			double a[3], b[3];
+			for(int k = 0; k < 3; ++k) {
+				a[k] = m_template[3*i + k] - ct[k];
+				b[k] = observed[3*i + k] - co[k];
+			}
+			for(int r = 0; r < 3; ++r) {
+				for(int c = 0; c < 3; ++c) {
+					s[r][c] += weights[i]*a[r]*b[c];
+				}
+			}
+		}
+
+		double n[4][4] = {
+			{s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0]},
+			{s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2]},
+			{s[2][0] - s[0][2], s[0][1] + s[1][0], s[1][1] - s[0][0] - s[2][2], s[1][2] + s[2][1]},
+			{s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], s[2][2] - s[0][0] - s[1][1]}
+		};
+		double values[4], vectors[4][4];
+		eigen(n, values, vectors);
+		int best = 0, second = -1;
+		for(int i = 1; i < 4; ++i) {
+			if(values[i] > values[best]) {
+				best = i;
+			}
+		}
+		for(int i = 0; i < 4; ++i) {
+			if(i != best && (second < 0 || values[i] > values[second])) {
+				second = i;
+			}
+		}
+		//points in a line leave the turn about it free: the top two eigenvalues match
+		double spread = fabs(values[best]) + fabs(values[second]);
+		if(spread <= 0.0 || values[best] - values[second] < 1.0e-6*spread) {
+			return false;
+		}
+
+		//q = (w, x, y, z), kept on the side of the last solution
+		double q[4] = {vectors[0][best], vectors[1][best], vectors[2][best], vectors[3][best]};
+		double dot = q[0]*m_last[3] + q[1]*m_last[4] + q[2]*m_last[5] + q[3]*m_last[6];
+		double norm = sqrt(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+		if(dot < 0.0) {
+			norm = -norm;
+		}
+		for(int k = 0; k < 4; ++k) {
+			q[k] /= norm;
+		}
+		double r[3][3];
+		rotation(q, r);
+		for(int k = 0; k < 3; ++k) {
+			pose[k] = float(co[k] - (r[k][0]*ct[0] + r[k][1]*ct[1] + r[k][2]*ct[2]));
+			pose[3 + k] = float(q[k]);
+		}
+		pose[6] = float(q[3]);
+
+		double e = 0.0;
+		for(int i = 0; i < m_count; ++i) {
+			if(weights[i] <= 0.0f) {
+				continue;
+			}
+			for(int k = 0; k < 3; ++k) {
+				const float* t = &m_template[3*i];
+				double d = pose[k] + r[k][0]*t[0] + r[k][1]*t[1] + r[k][2]*t[2] - observed[3*i + k];
+				e += weights[i]*d*d;
+			}
+		}
+		rms = float(sqrt(e/w));
+		memcpy(m_last, pose, sizeof(m_last));
+		return true;
+	}
+
+private:
+	//rotation matrix of the unit quaternion (w, x, y, z)
+	static void rotation(const double q[4], double r[3][3]) {
+		double w = q[0], x = q[1], y = q[2], z = q[3];
+		r[0][0] = 1.0 - 2.0*(y*y + z*z); r[0][1] = 2.0*(x*y - w*z);       r[0][2] = 2.0*(x*z + w*y);
+		r[1][0] = 2.0*(x*y + w*z);       r[1][1] = 1.0 - 2.0*(x*x + z*z); r[1][2] = 2.0*(y*z - w*x);
+		r[2][0] = 2.0*(x*z - w*y);       r[2][1] = 2.0*(y*z + w*x);       r[2][2] = 1.0 - 2.0*(x*x + y*y);
+	}
+
+	//cyclic Jacobi for a symmetric 4x4, eigenvectors in the columns
+	static void eigen(double a[4][4], double values[4], double v[4][4]) {
+		for(int i = 0; i < 4; ++i) {
+			for(int j = 0; j < 4; ++j) {
+				v[i][j] = i == j ? 1.0 : 0.0;
+			}
+		}
+		for(int sweep = 0; sweep < 16; ++sweep) {
+			double off = 0.0, diagonal = 0.0;
+			for(int i = 0; i < 4; ++i) {
+				diagonal += a[i][i]*a[i][i];
+				for(int j = i + 1; j < 4; ++j) {
+					off += a[i][j]*a[i][j];
+				}
+			}
+			if(off <= 1.0e-24*diagonal) {
+				break;
+			}
+			for(int p = 0; p < 3; ++p) {
+				for(int q = p + 1; q < 4; ++q) {
+					if(a[p][q] == 0.0) {
+						continue;
+					}
+					double theta = (a[q][q] - a[p][p])/(2.0*a[p][q]);
+					double t = (theta >= 0.0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1.0));
+					double c = 1.0/sqrt(t*t + 1.0);
+					double s = t*c;
+					for(int k = 0; k < 4; ++k) {
+						double akp = a[k][p], akq = a[k][q];
+						a[k][p] = c*akp - s*akq;
+						a[k][q] = s*akp + c*akq;
+					}
+					for(int k = 0; k < 4; ++k) {
+						double apk = a[p][k], aqk = a[q][k];
+						a[p][k] = c*apk - s*aqk;
+						a[q][k] = s*apk + c*aqk;
+					}
+					for(int k = 0; k < 4; ++k) {
+						double vkp = v[k][p], vkq = v[k][q];
+						v[k][p] = c*vkp - s*vkq;
+						v[k][q] = s*vkp + c*vkq;
+					}
+				}
+			}
+		}
+		for(int i = 0; i < 4; ++i) {
+			values[i] = a[i][i];
+		}
+	}
+
+	int m_count;
+	std::vector<float> m_template;    //3 per point, body frame
+	float m_last[7];                  //last solution, OWLRigid::pose layout
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
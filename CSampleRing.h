@@ -0,0 +1,89 @@
+//Fixed size single producer / single consumer ring buffer.
+//
+//All memory is allocated in the constructor, push() and pop() never allocate or
+//lock, so the read thread can hand samples to a slower consumer (e.g. the disk
+//writer) without ever waiting on it. When the consumer falls behind push() fails
+//and the caller decides what to do with the sample (count it, drop it, ...).
+//
+//Exactly one thread may push and exactly one thread may pop.
+
+#ifndef CSampleRingH
+#define CSampleRingH
+
+#include <boost/atomic.hpp>
+
+template <typename T>
+class cSampleRing {
+public:
+
+	//capacity is rounded up to a power of two
+	explicit cSampleRing(const unsigned int& capacity) : m_head(0), m_tail(0) {
+		unsigned int size = 1;
+		while(size < capacity) {
+			size <<= 1;
+		}
+		m_mask = size - 1;
+		m_buffer = new T[size];
+	}
+
+	~cSampleRing() {
+		delete[] m_buffer;
+	}
+
+	unsigned int capacity() const {
+		return m_mask + 1;
+	}
+
+	//number of samples waiting (approximate while the other side is active)
+	unsigned int size() const {
+		return m_head.load(boost::memory_order_acquire) - m_tail.load(boost::memory_order_acquire);
+	}
+
+	//Producer only. Returns false (and drops v) if the ring is full.
+	bool push(const T& v) {
+		unsigned int head = m_head.load(boost::memory_order_relaxed);
+		if(head - m_tail.load(boost::memory_order_acquire) > m_mask) {
+			return false;
+		}
+		m_buffer[head & m_mask] = v;
+		m_head.store(head + 1, boost::memory_order_release);
+		return true;
+	}
+
+	//Consumer only. Copies up to maxCount of the oldest samples to out, returns the count.
+	unsigned int pop(T* out, const unsigned int& maxCount) {
+		unsigned int tail = m_tail.load(boost::memory_order_relaxed);
+		unsigned int count = m_head.load(boost::memory_order_acquire) - tail;
+		if(count > maxCount) {
+			count = maxCount;
+		}
+		for(unsigned int i = 0; i < count; ++i) {
+			out[i] = m_buffer[(tail + i) & m_mask];
+		}
+		m_tail.store(tail + count, boost::memory_order_release);
+		return count;
+	}
+
+	//Consumer only. Drops everything currently waiting.
+	void clear() {
+		m_tail.store(m_head.load(boost::memory_order_acquire), boost::memory_order_release);
+	}
+
+private:
+	//not copyable
+	cSampleRing(const cSampleRing&);
+	cSampleRing& operator=(const cSampleRing&);
+
+	//head and tail are written by different threads, keep them on their own cache lines
+	char m_padFront[64];
+	boost::atomic<unsigned int> m_head;    //next slot to write (producer)
+	char m_padMiddle[64];
+	boost::atomic<unsigned int> m_tail;    //next slot to read (consumer)
+	char m_padBack[64];
+	unsigned int m_mask;
+	T* m_buffer;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
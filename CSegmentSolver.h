@@ -0,0 +1,128 @@
+//A segment between two groups of point markers (e.g. the two ends of a paddle).
+//
+//The sensor's markers are split in two: the first split markers are one end, the
+//rest the other. Each end is the cond weighted centroid of its markers that are seen.
+//The pose is
+//   position      the midpoint of the two ends
+//   orientation   the shortest rotation taking the reference axis onto the direction
+//                 from the first end to the second (as vizmat.Transform.makeVecRotVec)
+//The midpoint is found in OWL coordinates and mapped like any other position; the
+//direction is mapped to Vizard first and the rotation built there, so the reference
+//axis is in Vizard coordinates.
+
+#ifndef CSegmentSolverH
+#define CSegmentSolverH
+
+#include <math.h>
+#include <string.h>
+
+class cSegmentSolver {
+public:
+
+	cSegmentSolver() : m_split(1) {
+		m_axis[0] = 1.0f; m_axis[1] = 0.0f; m_axis[2] = 0.0f;
+		m_direction[0] = 1.0f; m_direction[1] = 0.0f; m_direction[2] = 0.0f;
+		m_midpoint[0] = 0.0f; m_midpoint[1] = 0.0f; m_midpoint[2] = 0.0f;
+	}
+
+	//markers [0, split) are the first end, the rest the second
+	void setSplit(const int& split) {
+		m_split = split;
+	}
+
+	int split() const {
+		return m_split;
+	}
+
+	//reference axis (Vizard coordinates), returns false (and keeps the old one) if it is zero
+	bool setAxis(const float axis[3]) {
+		float n = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+		if(n <= 0.0f) {
+			return false;
+		}
+		for(int k = 0; k < 3; ++k) {
+			m_axis[k] = axis[k]/n;
+		}
+		return true;
+	}
+
+	const float* axis() const {
+		return m_axis;
+	}
+
+	//Ends from count markers (3 floats each, weight 0 if not seen). Returns false, and
+	//leaves the midpoint and direction as they were, unless both ends have a marker.
+	bool solve(const float* observed, const float* weights, const int& count, float midpoint[3]) {
+		float ends[2][3] = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}};
+		float total[2] = {0.0f, 0.0f};
+		for(int i = 0; i < count; ++i) {
+			if(weights[i] <= 0.0f) {
+				continue;
+			}
+			int end = i < m_split ? 0 : 1;
+			total[end] += weights[i];
+			for(int k = 0; k < 3; ++k) {
+				ends[end][k] += weights[i]*observed[3*i + k];
+			}
+		}
+		if(total[0] <= 0.0f || total[1] <= 0.0f) {
+			memcpy(midpoint, m_midpoint, sizeof(m_midpoint));
+			return false;
+		}
+		for(int k = 0; k < 3; ++k) {
+			ends[0][k] /= total[0];
+			ends[1][k] /= total[1];
+			m_midpoint[k] = 0.5f*(ends[0][k] + ends[1][k]);
+			m_direction[k] = ends[1][k] - ends[0][k];
+		}
+		memcpy(midpoint, m_midpoint, sizeof(m_midpoint));
+		return true;
+	}
+
+	//first end to second end of the last solution (OWL coordinates, not normalized)
+	const float* direction() const {
+		return m_direction;
+	}
+
+	//Shortest rotation taking the axis onto direction (Vizard coordinates), quaternion
+	//in data[3..6] order (x, y, z, w). Opposite vectors turn half way about an axis
+	//perpendicular to both.
+	void orientation(const float direction[3], float q[4]) const {
+		float n = sqrtf(direction[0]*direction[0] + direction[1]*direction[1] + direction[2]*direction[2]);
+		if(n <= 0.0f) {
+			q[0] = 0.0f; q[1] = 0.0f; q[2] = 0.0f; q[3] = 1.0f;
+			return;
+		}
+		float b[3] = {direction[0]/n, direction[1]/n, direction[2]/n};
+		const float* a = m_axis;
+		float d = a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+		if(d < -0.999999f) {
+			//any axis perpendicular to a
+			float p[3] = {0.0f, -a[2], a[1]};
+			if(fabsf(a[0]) > 0.9f) {
+				p[0] = a[2]; p[1] = 0.0f; p[2] = -a[0];
+			}
+			float pn = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+			q[0] = p[0]/pn; q[1] = p[1]/pn; q[2] = p[2]/pn; q[3] = 0.0f;
+			return;
+		}
+		q[0] = a[1]*b[2] - a[2]*b[1];
+		q[1] = a[2]*b[0] - a[0]*b[2];
+		q[2] = a[0]*b[1] - a[1]*b[0];
+		q[3] = 1.0f + d;
+		float qn = sqrtf(q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3]);
+		for(int k = 0; k < 4; ++k) {
+			q[k] /= qn;
+		}
+	}
+
+private:
+	int m_split;                  //markers in the first end
+	float m_axis[3];              //unit reference axis, Vizard coordinates
+	float m_midpoint[3];          //last solution, OWL coordinates
+	float m_direction[3];
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
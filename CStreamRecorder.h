@@ -0,0 +1,168 @@
+//Continuous recording of one sensor straight to disk.
+//
+//The read thread hands each sample to record(), which only copies it into a fixed
+//size ring (no allocation, no lock). A separate writer thread calls drain() to move
+//whatever is waiting into the file, so memory stays bounded no matter how long the
+//session runs. If the writer ever falls behind far enough to fill the ring the
+//sample is dropped and counted in overflow(). Files are binary (CRecording.h)
+//unless text is asked for.
+//
+//Threads:
+//   start(), stop()     command thread, serialized with drain() by the owner's mutex
+//   record()            read thread only
+//   drain()             writer thread only
+
+#ifndef CStreamRecorderH
+#define CStreamRecorderH
+
+#include <fstream>
+#include <boost/atomic.hpp>
+
+#include "CRecording.h"
+#include "CSampleRing.h"
+
+enum EStreamState {
+	STREAM_IDLE = 0,        //no file open, record() ignores samples
+	STREAM_RUNNING = 1,     //samples go to the ring and on to the file
+	STREAM_STOPPING = 2     //no new samples, the writer finishes the file
+};
+
+class cStreamRecorder {
+public:
+
+	explicit cStreamRecorder(const unsigned int& capacity) : m_ring(capacity),
+		m_state(STREAM_IDLE), m_overflow(0), m_written(0), m_withOrientation(false), m_binary(true), m_stopEpoch(0) {}
+
+	~cStreamRecorder() {
+		if(m_file.is_open()) {
+			m_file.close();
+		}
+	}
+
+	//Open the file and start taking samples. info describes the sensor for the
+	//binary header (ignored for text). Fails if a previous recording is still
+	//being finished or the file cannot be opened.
+	bool start(const char* name, SRecordFileInfo& info, const bool& binary) {
+		if(m_state.load() != STREAM_IDLE) {
+			return false;
+		}
+		if(binary) {
+			m_file.open(name, std::ios::out | std::ios::binary);
+		} else {
+			m_file.open(name);
+		}
+		if(!m_file.good()) {
+			m_file.close();
+			return false;
+		}
+		m_binary = binary;
+		if(binary) {
+			WriteRecordFileHeader(m_file, info);
+		} else {
+			m_file.precision(12);
+		}
+		m_ring.clear();
+		m_overflow.store(0);
+		m_written = 0;
+		m_withOrientation = info.header.isRigid != 0;
+		m_state.store(STREAM_RUNNING);
+		return true;
+	}
+
+	//Stop taking samples; epoch is the read thread's loop counter at the time of the call.
+	void stop(const unsigned int& epoch) {
+		if(m_state.load() == STREAM_RUNNING) {
+			m_stopEpoch = epoch;
+			m_state.store(STREAM_STOPPING);
+		}
+	}
+
+	bool isRecording() const {
+		return m_state.load(boost::memory_order_acquire) == STREAM_RUNNING;
+	}
+
+	//Read thread: queue a sample (dropped and counted if the ring is full).
+	void record(const dataRecordMember& r) {
+		if(!isRecording()) {
+			return;
+		}
+		if(!m_ring.push(r)) {
+			m_overflow.fetch_add(1, boost::memory_order_relaxed);
+		}
+	}
+
+	//Writer thread: write everything waiting using scratch as a staging buffer.
+	//Once stopped, the file is closed when the read thread has moved past the loop
+	//it was in at stop() (epoch changed or the read thread is gone) and the ring is empty.
+	//Returns the number of samples written.
+	unsigned int drain(const unsigned int& epoch, const bool& readerStopped,
+		dataRecordMember* scratch, const unsigned int& scratchSize) {
+		int state = m_state.load();
+		if(state == STREAM_IDLE) {
+			return 0;
+		}
+		bool finishing = state == STREAM_STOPPING && (readerStopped || epoch != m_stopEpoch);
+		unsigned int total = 0;
+		unsigned int n;
+		while((n = m_ring.pop(scratch, scratchSize)) > 0) {
+			if(m_binary) {
+				for(unsigned int i = 0; i < n; ++i) {
+					WriteRecordBinary(m_file, scratch[i], m_withOrientation);
+				}
+			} else {
+				for(unsigned int i = 0; i < n; ++i) {
+					WriteRecordText(m_file, scratch[i], m_withOrientation);
+				}
+			}
+			total += n;
+		}
+		m_written += total;
+		if(finishing) {
+			if(m_binary) {
+				FinishRecordFile(m_file, m_written);
+			}
+			m_file.close();
+			m_state.store(STREAM_IDLE);
+		}
+		return total;
+	}
+
+	int state() const {
+		return m_state.load();
+	}
+
+	unsigned long overflow() const {
+		return m_overflow.load(boost::memory_order_relaxed);
+	}
+
+	//samples written to the file (writer side, read under the owner's mutex)
+	unsigned long written() const {
+		return m_written;
+	}
+
+	unsigned int waiting() const {
+		return m_ring.size();
+	}
+
+	unsigned int capacity() const {
+		return m_ring.capacity();
+	}
+
+private:
+	//not copyable
+	cStreamRecorder(const cStreamRecorder&);
+	cStreamRecorder& operator=(const cStreamRecorder&);
+
+	cSampleRing<dataRecordMember> m_ring;
+	boost::atomic<int> m_state;
+	boost::atomic<unsigned long> m_overflow;
+	unsigned long m_written;
+	std::ofstream m_file;
+	bool m_withOrientation;
+	bool m_binary;
+	unsigned int m_stopEpoch;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
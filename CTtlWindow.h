@@ -0,0 +1,183 @@
+//Recording only around TTL edges, so a session with a few events keeps a few seconds
+//per event instead of everything (memory and file size follow the events, not the
+//session length).
+//
+//Every sample of a recording sensor goes through add(), which decides what is kept:
+//   an edge on one of the watched TTL lines opens a window: the samples of the last
+//   pre seconds (held in a ring) are kept, then everything until post seconds after
+//   the edge; another edge while it is open moves the end on
+//   outside the windows only one sample in every decimation is kept (0 keeps none),
+//   as a thin baseline
+//Kept samples are flagged (RECORD_FLAG_WINDOW, RECORD_FLAG_TRIGGER, RECORD_FLAG_BASELINE)
+//and each closed window is described by an STtlWindow. Read thread only.
+
+#ifndef CTtlWindowH
+#define CTtlWindowH
+
+#include <vector>
+
+#include "CRecording.h"
+
+enum ETtlEdge {
+	TTL_EDGE_RISING = 1,
+	TTL_EDGE_FALLING = 2,
+	TTL_EDGE_BOTH = 3
+};
+
+struct STtlWindowSettings {
+	float pre;                    //seconds kept before the edge
+	float post;                   //seconds kept after the (last) edge, pre and post 0 is off
+	int lines;                    //TTL lines watched, bit 0 is ttl_0
+	int edge;                     //ETtlEdge
+	int decimation;               //keep 1 in this many samples outside windows, 0 none
+};
+
+//one window, times as dataRecordMember::time
+struct STtlWindow {
+	double trigger;               //the edge that opened it
+	int ttlBefore;                //TTL bits just before and at that edge
+	int ttlAfter;
+	int triggers;                 //edges while it was open, counting the first
+	double start;                 //first and last sample kept
+	double end;
+	unsigned long samples;        //samples kept in it
+};
+
+class cTtlWindowRecorder {
+public:
+
+	cTtlWindowRecorder() : m_open(false), m_closed(false), m_lastTtl(-1), m_baseline(0), m_ringStart(0), m_ringCount(0) {
+		m_settings.pre = 0.0f;
+		m_settings.post = 0.0f;
+		m_settings.lines = 1;
+		m_settings.edge = TTL_EDGE_RISING;
+		m_settings.decimation = 0;
+	}
+
+	//frequency sizes the pre-trigger ring. Starts over only if something changed.
+	void configure(const STtlWindowSettings& settings, const float& frequency) {
+		if(settings.pre == m_settings.pre && settings.post == m_settings.post && settings.lines == m_settings.lines
+			&& settings.edge == m_settings.edge && settings.decimation == m_settings.decimation) {
+			return;
+		}
+		m_settings = settings;
+		m_ring.assign(settings.pre > 0.0f ? int(settings.pre*frequency) + 2 : 0, dataRecordMember());
+		restart();
+	}
+
+	bool active() const {
+		return m_settings.pre > 0.0f || m_settings.post > 0.0f;
+	}
+
+	//Forget the TTL history and any open window (e.g. recording started again).
+	void restart() {
+		m_open = false;
+		m_closed = false;
+		m_lastTtl = -1;
+		m_baseline = 0;
+		m_ringStart = 0;
+		m_ringCount = 0;
+	}
+
+	//The recording stopped: an open window is closed there (takeClosed), the rest forgotten.
+	void finish() {
+		bool open = m_open;
+		restart();
+		if(open) {
+			m_closed = true;
+			m_finished = m_current;
+		}
+	}
+
+	//Append the samples to keep because of r to out (in time order), returns how many.
+	int add(const dataRecordMember& r, std::vector<dataRecordMember>& out) {
+		int changed = m_lastTtl < 0 ? 0 : (r.ttl ^ m_lastTtl) & m_settings.lines;
+		bool trigger = ((m_settings.edge & TTL_EDGE_RISING) != 0 && (changed & r.ttl) != 0)
+			|| ((m_settings.edge & TTL_EDGE_FALLING) != 0 && (changed & ~r.ttl) != 0);
+		int before = m_lastTtl;
+		m_lastTtl = r.ttl;
+		size_t size = out.size();
+
+		if(m_open && r.time > m_end) {
+			m_open = false;
+			m_closed = true;
+			m_finished = m_current;
+		}
+		if(trigger) {
+			if(!m_open) {
+				m_open = true;
+				m_current.trigger = r.time;
+				m_current.ttlBefore = before;
+				m_current.ttlAfter = r.ttl;
+				m_current.triggers = 0;
+				m_current.start = r.time;
+				m_current.samples = 0;
+				//the pre-trigger samples not already kept as baseline
+				for(int i = 0; i < m_ringCount; ++i) {
+					const dataRecordMember& p = m_ring[(m_ringStart + i) % m_ring.size()];
+					if(p.time >= r.time - m_settings.pre && (p.flags & RECORD_FLAG_BASELINE) == 0) {
+						keep(p, RECORD_FLAG_WINDOW, out);
+					}
+				}
+				m_ringCount = 0;
+			}
+			++m_current.triggers;
+			m_end = r.time + m_settings.post;
+			keep(r, RECORD_FLAG_WINDOW | RECORD_FLAG_TRIGGER, out);
+		} else if(m_open) {
+			keep(r, RECORD_FLAG_WINDOW, out);
+		} else {
+			dataRecordMember held = r;
+			if(m_settings.decimation > 0 && m_baseline++ % m_settings.decimation == 0) {
+				held.flags |= RECORD_FLAG_BASELINE;
+				out.push_back(held);
+			}
+			if(!m_ring.empty()) {
+				m_ring[(m_ringStart + m_ringCount) % m_ring.size()] = held;
+				if(m_ringCount < int(m_ring.size())) {
+					++m_ringCount;
+				} else {
+					m_ringStart = (m_ringStart + 1) % m_ring.size();
+				}
+			}
+		}
+		return int(out.size() - size);
+	}
+
+	//True once after a window has closed, with its description.
+	bool takeClosed(STtlWindow& window) {
+		if(!m_closed) {
+			return false;
+		}
+		m_closed = false;
+		window = m_finished;
+		return true;
+	}
+
+private:
+	void keep(const dataRecordMember& r, const unsigned int& flags, std::vector<dataRecordMember>& out) {
+		out.push_back(r);
+		out.back().flags |= flags;
+		if(m_current.samples == 0 || r.time < m_current.start) {
+			m_current.start = r.time;
+		}
+		m_current.end = r.time;
+		++m_current.samples;
+	}
+
+	STtlWindowSettings m_settings;
+	bool m_open;                          //a window is being kept
+	bool m_closed;                        //m_finished not taken yet
+	STtlWindow m_current;                 //the open (or last) window
+	STtlWindow m_finished;                //the last closed one
+	double m_end;                         //time the open window ends
+	int m_lastTtl;                        //< 0 before the first sample
+	unsigned long m_baseline;             //samples outside windows so far
+	std::vector<dataRecordMember> m_ring; //pre-trigger samples outside windows
+	int m_ringStart;
+	int m_ringCount;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -22,6 +22,50 @@
 //
 //Changed 5/13 
 //   Improved the memory management to avoid sampling issues
+//
+//Changed 10/26
+//   Poses are handed to UpdateSensor through a seqlock (CPoseSeqlock.h), so the
+//   read thread never waits on the render thread for the latest pose
+//   The read thread can wait between polls instead of spinning (CReadWait.h, command 12)
+//   Streaming recording straight to disk for long sessions (CStreamRecorder.h, commands 105-107)
+//   Recordings are written in a binary format by default (CRecording.h, CRecordingReader.h)
+//   Dumps are written by a background thread, poll them with command 109 (answers in data[7..])
+//   Per-sensor calibration applied to all sensors in one SIMD batch (CPoseTransform.h, commands 20-21)
+//   Latency and frame interval histograms, always on (CLatencyHistogram.h, commands 110-112)
+//   OWL calls go through a backend (COwlBackend.h): the live server, or a synthetic
+//   (server "sim:...") or replayed (server "replay:...") source for testing without hardware
+//   The clock reads integer ticks (QPC, CLOCK_MONOTONIC_RAW or an invariant TSC), once
+//   per OWL frame for every sensor; sample times are doubles (command 14 checks the clock)
+//   Clock sync with Vizard fits offset and drift over repeated samples (CClockSync.h,
+//   commands 114-115), every recorded time goes through the fitted mapping
+//   Optional per-sensor pose prediction to the display time (CPosePredictor.h, commands 116-118)
+//   Optional per-sensor smoothing (exponential, One Euro or Savitzky-Golay) in the read
+//   thread at the full OWL rate (CPoseFilter.h, command 119), recordings stay raw
+//   Rigid poses solved in the plugin from point markers and a template, for slave
+//   connections that cannot make OWL rigids (CRigidSolver.h, commands 22-23)
+//   Segment sensors: midpoint and orientation between two marker groups at the OWL rate,
+//   e.g. the paddle (CSegmentSolver.h, command 24)
+//   Gap filling: markers lost for a frame are placed from the sensor's geometry or carried
+//   on for a short while, filled samples are flagged in binary recordings (CMarkerGapFill.h,
+//   command 25)
+//   Rigid definitions are captured for every pending sensor from the same frames, and kept
+//   between runs in a cache file keyed by server and markers (CRigidCache.h, commands 26-28)
+//   The server starts on a background thread (command 8, x = 1 still blocks): connecting,
+//   rigid capture and tracker setup no longer stall Vizard, progress and per-sensor
+//   errors are polled with command 29
+//   UpdateSensor only copies the calling sensor's pose, and only when a new one was
+//   published, UpdateAllSensors (export or command 30) does every sensor in one call
+//   Every sample at the OWL rate is kept in a per-sensor ring (CPoseHistory.h), scripts
+//   read all samples since their last read with the ReadSensorSamples export (command 31)
+//   The same ring answers the pose at any past time, interpolated between the samples
+//   either side (commands 32-33), on the clock of the recordings
+//   Optional shared memory pose bus: every frame's poses in a seqlocked ring other local
+//   processes read without their own OWL connection (CPoseBus.h, CPoseBusClient.h, command 34)
+//   Recorded TTL values carry all four inputs as bits (ttl_0 lowest), and recording can
+//   keep only windows around TTL edges with a pre-trigger ring and a decimated baseline,
+//   each window listed with command 36 (CTtlWindow.h, command 35)
+//   Throughput counters for the read, writer, dump and Vizard threads, one JSON line per
+//   report so runs can be compared across versions (command 113)
 
 
 #include <stdio.h>
@@ -31,13 +75,42 @@
 #include <set>
 #include <string>
 #include <fstream>
+#include <deque>
+#include <sstream>
+#include <algorithm>
 
 #include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+#if defined(_WIN32)
 #include <windows.h>
+#else
+//the sensor entry points are plain exported symbols off Windows
+#define __declspec(x) __attribute__((visibility("default")))
+#endif
 
 #include "sensor.h"
 #include "owl.h"
+#include "COwlBackend.h"
+#include "COwlSynthetic.h"
+#include "COwlReplay.h"
 #include "CPrecisionClock.h"
+#include "CPoseSeqlock.h"
+#include "CReadWait.h"
+#include "CRecording.h"
+#include "CStreamRecorder.h"
+#include "CPoseTransform.h"
+#include "CLatencyHistogram.h"
+#include "CClockSync.h"
+#include "CPosePredictor.h"
+#include "CPoseFilter.h"
+#include "CRigidSolver.h"
+#include "CSegmentSolver.h"
+#include "CMarkerGapFill.h"
+#include "CRigidCache.h"
+#include "CPoseHistory.h"
+#include "CPoseBus.h"
+#include "CTtlWindow.h"
+#include "CRecordingReader.h"
 
 using namespace std;
 
@@ -53,6 +126,10 @@ size_t LOCAL_FLAGS = 0;//OWL_SLAVE;    //0 means this tries to grab the server
 const int RIGID_AVERAGE_SAMPLES = 10;
 const int MAX_RIGID_AVERAGE_TRIALS = 1000;     //stop trying to get rigid markers after this long
 
+//rigid definitions kept between runs (see CRigidCache.h), no file name for none (command 26)
+string RIGID_CACHE_FILE = "phasespace_rigids.cache";
+cRigidCache RIGID_CACHE;
+
 //set up the coordinate system
 //OFFSET units are from PhaseSpace (millimeters)
 //SCALE sets the units seen by Vizard (1 give mm, .1 gives cm, ...)
@@ -65,6 +142,11 @@ float OFFSET_X = 0.0f;
 float OFFSET_Y = 0.0f;
 float OFFSET_Z = 0.0f;
 
+//changes to SCALE, OFFSET, a sensor calibration or which sensors are running bump
+//the generation, the read thread then rebuilds its tables (under config_mutex)
+boost::mutex config_mutex;
+boost::atomic<unsigned int> CONFIG_GENERATION(0);
+
 //used to request that the origin be reset
 bool REQUEST_RESET_ORIGIN = false;
 int ORIGIN_ID = 0;
@@ -73,11 +155,60 @@ int ORIGIN_ID = 0;
 int MARKER_COUNT = 0;
 set<int> USED_MARKER;   //the used markers
 
-//flag if the server is going or not
-bool SERVER_STARTED = false;
+//flag if the server is going or not (set by the startup thread)
+boost::atomic<bool> SERVER_STARTED(false);
+
+//every owl call goes through this, made from OWL_SERVER when the server starts
+boost::scoped_ptr<cOwlBackend> OWL_BACKEND;
+
+//flag streaming (more reliable than owl), set by the startup thread and commands
+boost::atomic<bool> STREAMING(false);
+
+//The server is started by a startup thread (command 8). Command 8 waits for it unless the
+//script asks to carry on (x = 2), so the render thread need not wait on owlInit and the
+//rigid captures. While it runs it owns the server and the sensors: UpdateSensor does
+//nothing and CommandSensor only takes the few commands that are safe
+//(StartupCommandAllowed). Poll the progress with command 29.
+enum EStartState {
+	START_IDLE = 0,               //not asked to start
+	START_CONNECTING = 1,         //owlInit
+	START_CALIBRATING = 2,        //capturing rigid definitions
+	START_CONFIGURING = 3,        //creating the trackers
+	START_STREAMING = 4,          //read thread going
+	START_FAILED = 5              //could not connect, start again with command 8
+};
+boost::atomic<int> START_STATE(START_IDLE);
+boost::atomic<int> START_SENSORS_DONE(0);     //sensors set up so far
+boost::atomic<int> START_SENSORS_TOTAL(0);    //sensors to set up
+boost::atomic<int> START_FRAMES(0);           //frames sampled by the rigid capture so far
+boost::shared_ptr<boost::thread> START_THREAD;
+boost::atomic<bool> READ_STARTED(false);      //READ_THREAD has been made (read by the writer and Vizard threads)
+
+//every frame's poses for other processes (CPoseBus.h), made at the start if named (command 34)
+string POSE_BUS_NAME;
+cPoseBusWriter POSE_BUS;
+
+//true while the startup thread runs
+bool ServerStarting() {
+	int state = START_STATE;
+	return state == START_CONNECTING || state == START_CALIBRATING || state == START_CONFIGURING;
+}
 
-//flag streaming (more reliable than owl)
-bool STREAMING = false;
+//per-sensor progress through the start, and why it failed
+enum ESetupState {
+	SETUP_NONE = 0,               //not part of a start
+	SETUP_PENDING = 1,            //waiting its turn
+	SETUP_CALIBRATING = 2,        //its rigid definition is being captured
+	SETUP_CONFIGURING = 3,        //its tracker is being made
+	SETUP_STARTED = 4,
+	SETUP_FAILED = 5              //see ESetupError
+};
+enum ESetupError {
+	SETUP_ERROR_NONE = 0,
+	SETUP_ERROR_NO_MARKERS = 1,   //no markers added (command 5)
+	SETUP_ERROR_CAPTURE = 2,      //its markers could not be read for the rigid definition
+	SETUP_ERROR_TRACKER = 3       //OWL refused the tracker or one of its markers
+};
 
 //this is used to read the markers and rigids, only called by the first sensor, so no thread issues
 OWLRigid* GLOBAL_RIGIDS;
@@ -88,20 +219,38 @@ int RIGID_COUNT = 0;
 
 //align times with vizard
 cPrecisionClock simClock;  //a clock
-double timeOffset = 0.;   //add this to the clock's getCPUTimeSeconds to get the current vizard tick
+cClockSync CLOCK_SYNC;     //maps the clock's getCPUTimeSeconds to the vizard tick (under config_mutex)
 
 //threading stuff
 boost::shared_ptr<boost::thread> READ_THREAD;
 boost::mutex block_mutex;
 void threadMe();
-bool REQUEST_SHUTDOWN = false;
+boost::atomic<bool> REQUEST_SHUTDOWN(false);
+
+//how the read thread waits between polls (see CReadWait.h), picked up by threadMe
+int READ_WAIT_MODE = READ_WAIT_SPIN;
+double READ_WAIT_MARGIN = 0.001;        //seconds to wake before the next expected frame
+boost::atomic<bool> REQUEST_READ_WAIT_CHANGE(false);
+boost::atomic<bool> REQUEST_READ_WAIT_REPORT(false);
+
+//streaming recording (see CStreamRecorder.h)
+const unsigned int STREAM_RING_SIZE = 65536;   //samples buffered per sensor between the read and writer threads
+const unsigned int STREAM_CHUNK_SIZE = 1024;   //samples the writer moves per pass
+boost::shared_ptr<boost::thread> WRITER_THREAD;
+boost::mutex stream_mutex;                     //guards STREAM_RECORDERS and the recorders' files
+vector<cStreamRecorder*> STREAM_RECORDERS;     //every recorder created, owned here
+boost::atomic<bool> REQUEST_WRITER_SHUTDOWN(false);
+boost::atomic<unsigned int> READ_EPOCH(0);     //bumped by the read thread after each poll
+void writerThreadMe();
+
+//how a point sensor (not an OWL rigid) turns its markers into a pose
+enum ESensorSolve {
+	SENSOR_SOLVE_NONE = 0,        //the first marker's position
+	SENSOR_SOLVE_RIGID = 1,       //rigid pose fitted to all its markers (command 22)
+	SENSOR_SOLVE_SEGMENT = 2      //midpoint and direction between two groups of markers (command 24)
+};
 
 //struct to hold the individual sensor objects
-struct dataRecordMember {
-	float time, x, y, z;
-	int ttl;
-	float qw, qx, qy, qz;
-};
 struct SPhaseSpaceSensor{
 	VRUTSensorObj* instance;      //the Vizard object
 	int trackerID;                //unique for each sensor
@@ -114,10 +263,100 @@ struct SPhaseSpaceSensor{
 	int samples;                  //the number of samples taken (used for averaging)
 	bool requestRecording;        //record this marker (or rigid)
 	bool dumpRecording;           //dump this marker's data (or rigid)
-	float lastGood[7];           //store the last good measurement
+	float lastGood[7];           //store the last good measurement, in Vizard coordinates (read thread only)
 	vector<dataRecordMember> record;  //data record
+	cPoseSeqlock published;       //lastGood and samples as seen by UpdateSensor
+	boost::atomic<cStreamRecorder*> stream;  //streaming recorder, created on first use
+	int dumpState;                //EDumpState of the last dump queued (command 102), under dump_mutex
+	unsigned long dumpWritten;    //samples of that dump written so far, under dump_mutex
+	unsigned long dumpTotal;      //samples in that dump, under dump_mutex
+	unsigned int dumpSequence;    //number of that dump, only its job updates the three above
+	int dumpsPending;             //dumps queued or being written, under dump_mutex
+	bool hasCalibration;          //use calibration instead of the global scale/offset (command 20)
+	float calibration[12];        //3x4 row major OWL -> Vizard (see CPoseTransform.h), under config_mutex
+	cLatencyHistogram latency;    //age of the pose when UpdateSensor reads it (Vizard thread)
+	cLatencyHistogram interval;   //time between good samples (read thread)
+	double lastArrival;           //arrival time of the last good sample (read thread, < 0 if none)
+	int predictMode;              //EPredictMode used by UpdateSensor, the read thread only tracks rates if not hold
+	float predictHorizon;         //seconds past the UpdateSensor call the pose is predicted for
+	cPosePredictor predictor;     //motion rates (read thread)
+	SPoseFilterSettings filter;   //smoothing of the published pose (see CPoseFilter.h), under config_mutex
+	int solve;                    //ESensorSolve, fixed once started
+	cRigidSolver rigidSolver;     //template from rigidBodyDefinition (read thread once started)
+	cSegmentSolver segmentSolver; //marker groups and reference axis (read thread once started)
+	bool gapFill;                 //fill in lost markers (command 25), under config_mutex
+	float gapFillLimit;           //longest a lost marker is carried on (s), under config_mutex
+	cMarkerGapFiller gapFiller;   //read thread
+	boost::atomic<int> setupState; //ESetupState, written by the startup thread (command 29)
+	boost::atomic<int> setupError; //ESetupError once SETUP_FAILED
+	unsigned int shownGeneration; //publish generation last copied to the data fields (Vizard thread)
+	double shownArrival;          //its arrival time, < 0 before the first good sample (Vizard thread)
+	cPoseHistory history;         //every sample at the OWL rate, read thread -> Vizard thread (command 31)
+	float historySeconds;         //history kept (command 32), 0 for POSE_HISTORY_SIZE samples
+	STtlWindowSettings ttlWindow; //record only around TTL edges (command 35), under config_mutex
+	cTtlWindowRecorder ttlWindower; //read thread
+	bool ttlRecording;            //recording or streaming on the last frame (read thread)
+	vector<STtlWindow> windows;   //closed TTL windows of this recording, under block_mutex
 };
 
+//true if the sensor's pose carries an orientation (recordings keep it)
+bool HasOrientation(const SPhaseSpaceSensor* s) {
+	return s->isRigid || s->solve != SENSOR_SOLVE_NONE;
+}
+
+//time from a frame arriving in threadMe to all its poses being published (read thread)
+cLatencyHistogram PUBLISH_LATENCY;
+//mean time per sensor to solve poses from markers, once per frame (read thread)
+cLatencyHistogram SOLVE_COST;
+
+//throughput counters for the performance report (command 113), each has one writer
+cLatencyHistogram UPDATE_COST;                     //time per UpdateSensor/UpdateAllSensors call (Vizard thread)
+double READ_START = 0.0;                           //clock time the read thread started
+boost::atomic<unsigned long> READ_FRAMES(0);       //polls that returned data (read thread)
+boost::atomic<unsigned long> STREAM_SAMPLES(0);    //samples streamed to disk (writer thread)
+boost::atomic<boost::uint64_t> STREAM_BUSY_NS(0);  //writer time spent on them
+boost::atomic<unsigned long> DUMP_SAMPLES(0);      //samples dumped (dump thread)
+boost::atomic<boost::uint64_t> DUMP_BUSY_NS(0);    //dump thread time spent on them
+
+//Commands can answer the script through the data fields after the pose:
+//data[REPLY_FIELD .. REPLY_FIELD+REPLY_SIZE-1], read with <sensor>.get() in the script.
+//UpdateSensor only writes the pose, so an answer stays until the next command that answers.
+const int POSE_FIELDS = 7;
+const int REPLY_FIELD = POSE_FIELDS;
+const int REPLY_SIZE = 16;
+
+//Answer a command (unused reply fields are zeroed).
+void SetReply(VRUTSensorObj* sensor, const float* values, const int& count) {
+	for(int i = 0; i < REPLY_SIZE; ++i) {
+		sensor->data[REPLY_FIELD + i] = i < count ? values[i] : 0.0f;
+	}
+}
+
+//dumps (command 102) are written by a background thread so the record
+//only has to be swapped out under block_mutex
+enum EDumpState {
+	DUMP_NONE = 0,          //never dumped
+	DUMP_QUEUED = 1,        //waiting for the dump thread
+	DUMP_WRITING = 2,
+	DUMP_DONE = 3,          //file is complete
+	DUMP_FAILED = 4         //could not open the file (or the fallback)
+};
+struct SDumpJob {
+	int id;                       //sensor
+	unsigned int sequence;        //the sensor's dumpSequence when queued
+	string name;                  //file name
+	bool text;                    //old text format instead of binary
+	bool isRigid;
+	SRecordFileInfo info;         //binary header
+	vector<dataRecordMember> record;
+};
+boost::shared_ptr<boost::thread> DUMP_THREAD;
+boost::mutex dump_mutex;                  //guards DUMP_QUEUE, REQUEST_DUMP_SHUTDOWN and the sensors' dump status
+boost::condition_variable dump_condition;
+deque<SDumpJob*> DUMP_QUEUE;
+bool REQUEST_DUMP_SHUTDOWN = false;
+void dumpThreadMe();
+
 //struct for the commdata (new to the x2)
 struct packet{
 	unsigned char sysid[8];
@@ -128,6 +367,12 @@ struct packet{
 	bool ttl_3:1;
 };
 
+//the four TTL inputs of a commdata packet as bits, ttl_0 lowest
+int PacketTtl(const unsigned char* buffer) {
+	const packet* p = (const packet*)buffer;
+	return (p->ttl_0 ? 1 : 0) | (p->ttl_1 ? 2 : 0) | (p->ttl_2 ? 4 : 0) | (p->ttl_3 ? 8 : 0);
+}
+
 //Stream the data in a SPhaseSpaceSensor for debugging/checking.
 ostream& operator<<(ostream& out, const SPhaseSpaceSensor& s) {
 	out << "   Server ip: " << OWL_SERVER << "\n";
@@ -138,8 +383,10 @@ ostream& operator<<(ostream& out, const SPhaseSpaceSensor& s) {
 	}
 	out << "\n";
 	if(s.isStarted) {
+		SPoseSnapshot snapshot;
+		s.published.read(snapshot);
 		out << "   Started = true.\n";
-		out << "   Samples on last trial = " << s.samples << "\n";
+		out << "   Samples on last trial = " << snapshot.samples << "\n";
 	} else {
 		out << "   Started = false.\n";
 	}
@@ -147,8 +394,8 @@ ostream& operator<<(ostream& out, const SPhaseSpaceSensor& s) {
 		out << "   Needs initialization = true ... do not trust output.\n";
 	} else {
 		//don't try to access an uninitialized rigid body
-		if(s.isRigid) {
-			out << "   This is a rigid body\n" << flush;
+		if(s.isRigid || (s.solve == SENSOR_SOLVE_RIGID && s.rigidBodyDefinition.size() == s.markers.size())) {
+			out << (s.isRigid ? "   This is a rigid body\n" : "   This is a rigid body solved from point markers\n") << flush;
 			out << "   Tracker ID is " << s.trackerID << "\n" << flush;
 			for(int i = 0; i < s.markers.size(); ++i) {
 				out << "      Marker " << s.markers[i] << " -> (" << flush;
@@ -168,32 +415,152 @@ vector<SPhaseSpaceSensor*> ALL_SENSORS;
 
 //vector<double> counterHack;
 
-void DoDumpFile(const int& id, char* name) {
-	boost::mutex::scoped_lock l(block_mutex);
+//Describe a sensor for the header of a binary recording.
+void FillRecordFileInfo(const int& id, SRecordFileInfo& info) {
+	SPhaseSpaceSensor* s = ALL_SENSORS[id];
+	InitRecordFileHeader(info.header);
+	info.header.sensorId = id;
+	info.header.trackerId = s->trackerID;
+	info.header.isRigid = HasOrientation(s) ? 1 : 0;
+	info.header.scale[0] = SCALE_X; info.header.scale[1] = SCALE_Y; info.header.scale[2] = SCALE_Z;
+	info.header.offset[0] = OFFSET_X; info.header.offset[1] = OFFSET_Y; info.header.offset[2] = OFFSET_Z;
+	info.header.frequency = LOCAL_OWL_FREQUENCY;
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		info.header.timeOffset = CLOCK_SYNC.offsetAt(simClock.getCPUTimeSeconds());
+	}
+	strncpy(info.header.server, OWL_SERVER.c_str(), sizeof(info.header.server)-1);
+	info.markers.assign(s->markers.begin(), s->markers.end());
+	info.rigidDefinition.clear();
+	if(HasOrientation(s) && s->rigidBodyDefinition.size() == s->markers.size()) {
+		for(int i = 0; i < s->rigidBodyDefinition.size(); ++i) {
+			info.rigidDefinition.push_back(s->rigidBodyDefinition[i][0]);
+			info.rigidDefinition.push_back(s->rigidBodyDefinition[i][1]);
+			info.rigidDefinition.push_back(s->rigidBodyDefinition[i][2]);
+		}
+	}
+}
+
+//Update the sensor's dump status for a job, unless a later dump of the sensor has
+//been queued since (command 109 reports the latest dump).
+void SetDumpStatus(const SDumpJob& job, const int& state, const unsigned long& written) {
+	boost::mutex::scoped_lock l(dump_mutex);
+	SPhaseSpaceSensor* s = ALL_SENSORS[job.id];
+	if(state == DUMP_DONE || state == DUMP_FAILED) {
+		--s->dumpsPending;
+	}
+	if(job.sequence == s->dumpSequence) {
+		s->dumpState = state;
+		s->dumpWritten = written;
+	}
+}
+
+//Write a dump job to its file, binary (CRecording.h) unless text is requested.
+//Runs on the dump thread, nothing here touches the live sensor except its dump status.
+void WriteDumpJob(SDumpJob& job) {
+	SetDumpStatus(job, DUMP_WRITING, 0);
+	double started = simClock.getCPUTimeSeconds();
 
 	ofstream dumpFile;
-	dumpFile.open(name);
+	if(job.text) {
+		dumpFile.open(job.name.c_str());
+	} else {
+		dumpFile.open(job.name.c_str(), ios::out | ios::binary);
+	}
 	if(!dumpFile.good()) {
-		cout << "Warning: could not open " << name << " for writing ... will use test_ps_dump.txt\n" << flush;
+		const char* fallback = job.text ? "test_ps_dump.txt" : "test_ps_dump.psr";
+		cout << "Warning: could not open " << job.name << " for writing ... will use " << fallback << "\n" << flush;
 		dumpFile.close();
-		dumpFile.open("test_ps_dump.txt");
-	}
-	dumpFile.precision(12);
-	for(int i = 0; i < ALL_SENSORS[id]->record.size(); ++i) {
-		dumpFile << ALL_SENSORS[id]->record[i].time << " "
-			<< ALL_SENSORS[id]->record[i].ttl << " "
-			<< ALL_SENSORS[id]->record[i].x << " "
-			<< ALL_SENSORS[id]->record[i].y << " "
-			<< ALL_SENSORS[id]->record[i].z;
-		if(ALL_SENSORS[id]->isRigid) {
-			dumpFile << " " << ALL_SENSORS[id]->record[i].qw << " "
-				<< ALL_SENSORS[id]->record[i].qx << " "
-				<< ALL_SENSORS[id]->record[i].qy << " "
-				<< ALL_SENSORS[id]->record[i].qz;
-		}
-		dumpFile << "\n";
+		if(job.text) {
+			dumpFile.open(fallback);
+		} else {
+			dumpFile.open(fallback, ios::out | ios::binary);
+		}
+		if(!dumpFile.good()) {
+			cout << "Error: could not open " << fallback << " either ... dump lost\n" << flush;
+			SetDumpStatus(job, DUMP_FAILED, 0);
+			return;
+		}
+	}
+	const vector<dataRecordMember>& record = job.record;
+	if(job.text) {
+		dumpFile.precision(12);
+	} else {
+		WriteRecordFileHeader(dumpFile, job.info);
+	}
+	for(int i = 0; i < record.size(); ++i) {
+		if(job.text) {
+			WriteRecordText(dumpFile, record[i], job.isRigid);
+		} else {
+			WriteRecordBinary(dumpFile, record[i], job.isRigid);
+		}
+		if((i & 4095) == 4095) {
+			SetDumpStatus(job, DUMP_WRITING, i+1);
+		}
+	}
+	if(!job.text) {
+		FinishRecordFile(dumpFile, record.size());
 	}
 	dumpFile.close();
+	DUMP_SAMPLES.fetch_add(record.size(), boost::memory_order_relaxed);
+	DUMP_BUSY_NS.fetch_add(boost::uint64_t(1.0e9*(simClock.getCPUTimeSeconds() - started)), boost::memory_order_relaxed);
+	SetDumpStatus(job, DUMP_DONE, record.size());
+}
+
+//Writes queued dumps one at a time, finishes the queue before shutting down.
+void dumpThreadMe() {
+	while(true) {
+		SDumpJob* job = NULL;
+		{
+			boost::mutex::scoped_lock l(dump_mutex);
+			while(DUMP_QUEUE.empty() && !REQUEST_DUMP_SHUTDOWN) {
+				dump_condition.wait(l);
+			}
+			if(DUMP_QUEUE.empty()) {
+				return;
+			}
+			job = DUMP_QUEUE.front();
+			DUMP_QUEUE.pop_front();
+		}
+		WriteDumpJob(*job);
+		delete job;
+	}
+}
+
+//Queue the sensor's record to be written to a file.
+//The record is swapped out under block_mutex in O(1) (a fresh, preallocated record
+//takes its place) so acquisition and rendering carry on while the file is written.
+//The dumped samples leave the sensor, a later dump only holds what was recorded since.
+void DoDumpFile(const int& id, char* name, const bool& text) {
+	SDumpJob* job = new SDumpJob();
+	job->id = id;
+	job->name = name;
+	job->text = text;
+	job->isRigid = HasOrientation(ALL_SENSORS[id]);
+	FillRecordFileInfo(id, job->info);
+
+	vector<dataRecordMember> fresh;
+	fresh.reserve(PREALLOCATION_SIZE);
+	{
+		boost::mutex::scoped_lock l(block_mutex);
+		job->record.swap(ALL_SENSORS[id]->record);
+		ALL_SENSORS[id]->record.swap(fresh);
+	}
+
+	{
+		boost::mutex::scoped_lock l(dump_mutex);
+		SPhaseSpaceSensor* s = ALL_SENSORS[id];
+		job->sequence = ++s->dumpSequence;
+		s->dumpState = DUMP_QUEUED;
+		s->dumpWritten = 0;
+		s->dumpTotal = job->record.size();
+		++s->dumpsPending;
+		DUMP_QUEUE.push_back(job);
+		if(!DUMP_THREAD) {
+			DUMP_THREAD.reset(new boost::thread(dumpThreadMe));
+		}
+	}
+	dump_condition.notify_one();
 
 	//ofstream ch("counter_hack.txt");
 	//ch.precision(10);
@@ -211,6 +578,8 @@ extern "C" __declspec(dllexport) void CommandSensor(void *);
 extern "C" __declspec(dllexport) void ResetSensor(void *);
 extern "C" __declspec(dllexport) void CloseSensor(void *);
 //  end DO NOT MODIFY---------------------------------
+extern "C" __declspec(dllexport) void UpdateAllSensors();
+extern "C" __declspec(dllexport) int ReadSensorSamples(int, SPoseSample*, int);
 
 //Safely enable/disable streaming.
 //Only acts if this would change the streaming state.
@@ -221,13 +590,13 @@ void SetOwlStreaming(const bool& b) {
 		return;
 	}
 	if(b && !STREAMING) {
-		owlSetInteger(OWL_STREAMING, OWL_ENABLE);
-		owlSetInteger(OWL_COMMDATA, OWL_ENABLE);
+		OWL_BACKEND->setInteger(OWL_STREAMING, OWL_ENABLE);
+		OWL_BACKEND->setInteger(OWL_COMMDATA, OWL_ENABLE);
 		STREAMING = true;
 	} else if (!b && STREAMING){
 		STREAMING = false;
-		owlSetInteger(OWL_COMMDATA, OWL_DISABLE);
-		owlSetInteger(OWL_STREAMING, OWL_DISABLE);
+		OWL_BACKEND->setInteger(OWL_COMMDATA, OWL_DISABLE);
+		OWL_BACKEND->setInteger(OWL_STREAMING, OWL_DISABLE);
 	} else {
 		return;
 	}
@@ -244,89 +613,158 @@ void UpdateRigidCount() {
 	}
 }
 
-//Define relative locations of the rigid body.
-//Can test for error if the returned vector has size 0
-vector<float*> CreateRigidLocations(const int& id) {
-	vector<float*> rigidTemp;
+//Define relative locations of the rigid bodies of several sensors at once.
+//A sensor is sampled only from frames where all of its markers are seen, so its
+//definition is not mixed from different moments, until it has RIGID_AVERAGE_SAMPLES
+//such frames (or MAX_RIGID_AVERAGE_TRIALS frames go by), and each coordinate is the
+//median of its samples, so a stray frame does not move the definition.
+//definitions[k] is for ids[k], size 0 if its markers could not be read.
+//A slave connection cannot make trackers, it reads the markers the master streams.
+void CreateRigidLocations(const vector<int>& ids, vector<vector<float*> >& definitions) {
+	definitions.assign(ids.size(), vector<float*>());
 
 	//check that we're streaming (should be), already checked size
 	if(!SERVER_STARTED) {
 		cout << "Error in rigid body creation: PhaseSpace server not started ... fail\n";
-		return rigidTemp;
+		return;
 	}
 
-	//create the object
-	int i;
-	int markerCount = ALL_SENSORS[id]->markers.size();
-
 	//stream some data from OWL
 	OWLMarker * markers = new OWLMarker[MARKER_COUNT];
-	int n = -1; 
 
 	//clear/initialize the stream
-	int tracker = ALL_SENSORS[id]->trackerID;
-	owlTrackeri(tracker, OWL_CREATE, OWL_POINT_TRACKER);
-	for(int i = 0; i < ALL_SENSORS[id]->markers.size(); ++i) {
-		owlMarkeri(MARKER(tracker,i), OWL_SET_LED, ALL_SENSORS[id]->markers.at(i));
+	bool slave = (LOCAL_FLAGS & OWL_SLAVE) == OWL_SLAVE;
+	if(!slave) {
+		for(int k = 0; k < ids.size(); ++k) {
+			int tracker = ALL_SENSORS[ids[k]]->trackerID;
+			OWL_BACKEND->trackeri(tracker, OWL_CREATE, OWL_POINT_TRACKER);
+			for(int i = 0; i < ALL_SENSORS[ids[k]]->markers.size(); ++i) {
+				OWL_BACKEND->markeri(MARKER(tracker,i), OWL_SET_LED, ALL_SENSORS[ids[k]]->markers.at(i));
+			}
+			OWL_BACKEND->tracker(tracker, OWL_ENABLE);
+		}
 	}
-	owlTracker(tracker, OWL_ENABLE);
 	SetOwlStreaming(true);
-	while(owlGetMarkers(markers, MARKER_COUNT) > 0) {}
-
-	//dynamically grab the rigid body positions
-	for(i = 0; i < markerCount; ++i) {
-		int markerID = ALL_SENSORS[id]->markers[i];
-		float* newPoint = new float[3];
-		newPoint[0] = 0.0f;
-		newPoint[1] = 0.0f;
-		newPoint[2] = 0.0f;
-		int count = 0;
-		int trial = 0;
-		do {
-			n = owlGetMarkers(markers, MARKER_COUNT);
-			if(n > 0) {
-				if(markers[markerID].cond > 0.1f) {
-					newPoint[0] += markers[markerID].x;
-					newPoint[1] += markers[markerID].y;
-					newPoint[2] += markers[markerID].z;
-					++count;
+	while(OWL_BACKEND->getMarkers(markers, MARKER_COUNT) > 0) {}
+
+	//samples[k][i] holds x, y, z of marker i of sensor k from each frame that saw all of
+	//the sensor's markers; seen[k][i] counts the frames that saw marker i, for the errors
+	vector<vector<vector<float> > > samples(ids.size());
+	vector<vector<int> > seen(ids.size());
+	int waiting = 0;
+	for(int k = 0; k < ids.size(); ++k) {
+		samples[k].resize(ALL_SENSORS[ids[k]]->markers.size());
+		seen[k].assign(ALL_SENSORS[ids[k]]->markers.size(), 0);
+		if(!samples[k].empty()) {
+			++waiting;
+		}
+	}
+	int trial = 0;
+	//nothing waits on the capture, so sleep until the next frame instead of spinning
+	cReadWait wait;
+	wait.setMode(READ_WAIT_FRAME_SLEEP, LOCAL_OWL_FREQUENCY, READ_WAIT_MARGIN, simClock.getCPUTimeSeconds());
+	//CloseSensor can stop a capture that is waiting on frames
+	while(waiting > 0 && trial < MAX_RIGID_AVERAGE_TRIALS && !REQUEST_SHUTDOWN) {
+		bool gotFrame = OWL_BACKEND->getMarkers(markers, MARKER_COUNT) > 0;
+		wait.afterPoll(gotFrame, simClock.getCPUTimeSeconds());
+		if(!gotFrame) {
+			continue;
+		}
+		++trial;
+		++START_FRAMES;
+		for(int k = 0; k < ids.size(); ++k) {
+			if(samples[k].empty() || samples[k][0].size() == 3*RIGID_AVERAGE_SAMPLES) {
+				continue;
+			}
+			bool all = true;
+			for(int i = 0; i < samples[k].size(); ++i) {
+				if(markers[ALL_SENSORS[ids[k]]->markers[i]].cond > 0.1f) {
+					++seen[k][i];
 				} else {
-					///////This dumps too many times normally////
-					//  cout << "   Error in rigid body creation: unable to see marker " << " " << markerID 
-					//     << " strength = " << markers[markerID].cond 
-					//     << "\n   If this persists close and check the markers.\n" << flush;
+					all = false;
 				}
-				++trial;
 			}
-		} while(count < RIGID_AVERAGE_SAMPLES && trial < MAX_RIGID_AVERAGE_TRIALS);
-		if(trial < MAX_RIGID_AVERAGE_TRIALS) {
-			newPoint[0] /= float(RIGID_AVERAGE_SAMPLES);
-			newPoint[1] /= float(RIGID_AVERAGE_SAMPLES);
-			newPoint[2] /= float(RIGID_AVERAGE_SAMPLES);
-			rigidTemp.push_back(newPoint);
-		} else {
-			cout << "Error: unable to read markers ... fail\n" << flush;
-			return rigidTemp;
+			if(!all) {
+				continue;
+			}
+			for(int i = 0; i < samples[k].size(); ++i) {
+				const OWLMarker& m = markers[ALL_SENSORS[ids[k]]->markers[i]];
+				samples[k][i].push_back(m.x);
+				samples[k][i].push_back(m.y);
+				samples[k][i].push_back(m.z);
+			}
+			if(samples[k][0].size() == 3*RIGID_AVERAGE_SAMPLES) {
+				--waiting;
+			}
 		}
 	}
 
-	//define the first marker as 0,0,0
-	for(i = 1; i < rigidTemp.size(); ++i) {
-		rigidTemp[i][0] -= rigidTemp[0][0];
-		rigidTemp[i][1] -= rigidTemp[0][1];
-		rigidTemp[i][2] -= rigidTemp[0][2];
+	for(int k = 0; k < ids.size(); ++k) {
+		vector<float*>& rigidTemp = definitions[k];
+		for(int i = 0; i < samples[k].size(); ++i) {
+			vector<float>& v = samples[k][i];
+			if(v.size() < 3*RIGID_AVERAGE_SAMPLES) {
+				int worst = int(min_element(seen[k].begin(), seen[k].end()) - seen[k].begin());
+				cout << "Error: unable to see all markers of sensor " << ids[k] << " together (" << v.size()/3
+					<< " good frames, marker " << ALL_SENSORS[ids[k]]->markers[worst] << " seen in "
+					<< seen[k][worst] << " of " << trial << ") ... fail\n" << flush;
+				break;
+			}
+			float* newPoint = new float[3];
+			vector<float> coordinate(RIGID_AVERAGE_SAMPLES);
+			for(int c = 0; c < 3; ++c) {
+				for(int j = 0; j < RIGID_AVERAGE_SAMPLES; ++j) {
+					coordinate[j] = v[3*j + c];
+				}
+				nth_element(coordinate.begin(), coordinate.begin() + RIGID_AVERAGE_SAMPLES/2, coordinate.end());
+				newPoint[c] = coordinate[RIGID_AVERAGE_SAMPLES/2];
+			}
+			rigidTemp.push_back(newPoint);
+		}
+		if(rigidTemp.size() != samples[k].size()) {
+			for(int i = 0; i < rigidTemp.size(); ++i) {
+				delete[] rigidTemp[i];
+			}
+			rigidTemp.clear();
+			continue;
+		}
+
+		//define the first marker as 0,0,0
+		for(int i = 1; i < rigidTemp.size(); ++i) {
+			rigidTemp[i][0] -= rigidTemp[0][0];
+			rigidTemp[i][1] -= rigidTemp[0][1];
+			rigidTemp[i][2] -= rigidTemp[0][2];
+		}
+		rigidTemp[0][0] = 0.0f;
+		rigidTemp[0][1] = 0.0f;
+		rigidTemp[0][2] = 0.0f;
 	}
-	rigidTemp[0][0] = 0.0f;
-	rigidTemp[0][1] = 0.0f;
-	rigidTemp[0][2] = 0.0f;
+	cout << "Rigid body definitions for " << ids.size() << " sensor(s) from " << trial << " frames\n" << flush;
 
 	//clean up the stream
 	SetOwlStreaming(false);
-	owlTracker(tracker, OWL_DISABLE);
-	owlTracker(tracker, OWL_DESTROY);
+	if(!slave) {
+		for(int k = 0; k < ids.size(); ++k) {
+			OWL_BACKEND->tracker(ALL_SENSORS[ids[k]]->trackerID, OWL_DISABLE);
+			OWL_BACKEND->tracker(ALL_SENSORS[ids[k]]->trackerID, OWL_DESTROY);
+		}
+	}
 	delete[] markers;
+}
+
+//Define relative locations of one sensor's rigid body.
+//Can test for error if the returned vector has size 0
+vector<float*> CreateRigidLocations(const int& id) {
+	vector<vector<float*> > definitions;
+	CreateRigidLocations(vector<int>(1, id), definitions);
+	return definitions[0];
+}
 
-	return rigidTemp;
+//True if the sensor needs a rigid definition captured when it starts.
+bool NeedsRigidLocations(const int& id) {
+	SPhaseSpaceSensor* s = ALL_SENSORS[id];
+	return (s->isRigid || s->solve == SENSOR_SOLVE_RIGID) && s->markers.size() > 0
+		&& s->rigidBodyDefinition.size() != s->markers.size();
 }
 
 //set up tracker
@@ -337,22 +775,40 @@ void SetUpSensor(const int& id) {
 		return;
 	}
 
-	//Get the sensor pointed to by the local id
-	VRUTSensorObj* sensor = ALL_SENSORS[id]->instance;
-
 	if(ALL_SENSORS[id]->markers.size() == 0) {
 		cout << "Warning in phasespace: no markers set for sensor " << id 
 			<< " (in order of creation) ... ignoring\n" << flush;
 		ALL_SENSORS[id]->isStarted = false;
 		ALL_SENSORS[id]->needsInitialization = false;
+		ALL_SENSORS[id]->setupError = SETUP_ERROR_NO_MARKERS;
 		return;
 	}
 
+	//a rigid solved here needs its template, captured like an OWL rigid's unless it was given (command 23)
+	if(ALL_SENSORS[id]->solve == SENSOR_SOLVE_RIGID) {
+		if(ALL_SENSORS[id]->rigidBodyDefinition.size() != ALL_SENSORS[id]->markers.size()) {
+			ALL_SENSORS[id]->rigidBodyDefinition = CreateRigidLocations(id);
+		}
+		if(ALL_SENSORS[id]->rigidBodyDefinition.size() != ALL_SENSORS[id]->markers.size()) {
+			cout << "Error in rigid body creation: unable to capture markers ... skipping\n" << flush;
+			ALL_SENSORS[id]->setupError = SETUP_ERROR_CAPTURE;
+			ALL_SENSORS[id]->isStarted = false;
+			ALL_SENSORS[id]->needsInitialization = false;
+			return;
+		}
+		vector<float> points;
+		for(int i = 0; i < ALL_SENSORS[id]->rigidBodyDefinition.size(); ++i) {
+			points.insert(points.end(), ALL_SENSORS[id]->rigidBodyDefinition[i], ALL_SENSORS[id]->rigidBodyDefinition[i] + 3);
+		}
+		ALL_SENSORS[id]->rigidSolver.setTemplate(&points[0], ALL_SENSORS[id]->markers.size());
+	}
+
 	if( (LOCAL_FLAGS & OWL_SLAVE) == OWL_SLAVE ) {
 		//server is already going, so no need to initialize anything
 		SetOwlStreaming(true);
 		ALL_SENSORS[id]->isStarted = true;
 		ALL_SENSORS[id]->needsInitialization = false;
+		++CONFIG_GENERATION;
 		return;
 	}
 
@@ -363,8 +819,9 @@ void SetUpSensor(const int& id) {
 	int tracker = ALL_SENSORS[id]->trackerID;
 	if(ALL_SENSORS[id]->isStarted) {
 		ALL_SENSORS[id]->isStarted = false; //tell other threads not to access this
-		owlTracker(tracker, OWL_DISABLE);
-		owlTracker(tracker, OWL_DESTROY);
+		++CONFIG_GENERATION;
+		OWL_BACKEND->tracker(tracker, OWL_DISABLE);
+		OWL_BACKEND->tracker(tracker, OWL_DESTROY);
 	}
 
 	if(ALL_SENSORS[id]->isRigid) {
@@ -373,67 +830,70 @@ void SetUpSensor(const int& id) {
 		//create the rigid body definition (must be called before attempting to create the 
 		//   rigid body because it used the same markers).
 		//Create rigid locations will clean up after itself
+		//StartServer captures every pending sensor's definition in one go beforehand
 		//cout << "gh0\n" << flush;
-		ALL_SENSORS[id]->rigidBodyDefinition = CreateRigidLocations(id);
+		if(NeedsRigidLocations(id)) {
+			ALL_SENSORS[id]->rigidBodyDefinition = CreateRigidLocations(id);
+		}
 		//cout << "gh1\n" << flush;
 		if(ALL_SENSORS[id]->rigidBodyDefinition.size() != ALL_SENSORS[id]->markers.size()) {
 			cout << "Error in rigid body creation: unable to capture markers ... skipping\n" << flush;
+			ALL_SENSORS[id]->setupError = SETUP_ERROR_CAPTURE;
 			ALL_SENSORS[id]->isStarted = false;
 			ALL_SENSORS[id]->needsInitialization = false;
-			sensor->status = false;
 			return;
 		}
 
 		//create the tracker for this sensor
-		owlTrackeri(tracker, OWL_CREATE, OWL_RIGID_TRACKER);
-		if(!owlGetStatus()) { // 0-- errors, 1- correct
+		OWL_BACKEND->trackeri(tracker, OWL_CREATE, OWL_RIGID_TRACKER);
+		if(!OWL_BACKEND->getStatus()) { // 0-- errors, 1- correct
 			cout << "Error in tracker setup: unable to create tracker " << tracker << " .. skipping.\n" << flush;
+			ALL_SENSORS[id]->setupError = SETUP_ERROR_TRACKER;
 			ALL_SENSORS[id]->isStarted = false;
 			ALL_SENSORS[id]->needsInitialization = false;
-			sensor->status = false;
 			return;
 		}
 
 		//Initialize the tracker
 		for(int i = 0; i < ALL_SENSORS[id]->markers.size(); i++) {
 			int currentMarker = ALL_SENSORS[id]->markers.at(i);
-			owlMarkeri(MARKER(tracker, i), OWL_SET_LED, currentMarker);
-			if(!owlGetStatus()) {
+			OWL_BACKEND->markeri(MARKER(tracker, i), OWL_SET_LED, currentMarker);
+			if(!OWL_BACKEND->getStatus()) {
 				ALL_SENSORS[id]->isStarted = false;
 				ALL_SENSORS[id]->needsInitialization = false;
 				cout << "Error in default tracker setup: unable to add marker " 
 					<< currentMarker << " to tracker " << tracker << "\n" << flush;
-				sensor->status = false;
-				return;
+				ALL_SENSORS[id]->setupError = SETUP_ERROR_TRACKER;
+					return;
 			}
-			owlMarkerfv(MARKER(tracker, i), OWL_SET_POSITION, ALL_SENSORS[id]->rigidBodyDefinition.at(i));
-			if(!owlGetStatus()) {
+			OWL_BACKEND->markerfv(MARKER(tracker, i), OWL_SET_POSITION, ALL_SENSORS[id]->rigidBodyDefinition.at(i));
+			if(!OWL_BACKEND->getStatus()) {
 				ALL_SENSORS[id]->isStarted = false;
 				ALL_SENSORS[id]->needsInitialization = false;
 				cout << "Error in tracker setup: unable to add rigid body ... ignoring\n" << flush;
-				sensor->status = false;
-				return;
+				ALL_SENSORS[id]->setupError = SETUP_ERROR_TRACKER;
+					return;
 			}
 		}
-		owlTracker(tracker, OWL_ENABLE);
+		OWL_BACKEND->tracker(tracker, OWL_ENABLE);
 
-		if(!owlGetStatus()) {
+		if(!OWL_BACKEND->getStatus()) {
 			cout << "Error in default tracker setup: unable to start tracker.\n" << flush;
-			sensor->status = false;
+			ALL_SENSORS[id]->setupError = SETUP_ERROR_TRACKER;
 			return;
 		}
 
 	} else {
 		//handle point trackers here
-		owlTrackeri(tracker, OWL_CREATE, OWL_POINT_TRACKER);
+		OWL_BACKEND->trackeri(tracker, OWL_CREATE, OWL_POINT_TRACKER);
 		for(int i = 0; i < ALL_SENSORS[id]->markers.size(); ++i) {
-			owlMarkeri(MARKER(tracker,i), OWL_SET_LED, ALL_SENSORS[id]->markers.at(i));
+			OWL_BACKEND->markeri(MARKER(tracker,i), OWL_SET_LED, ALL_SENSORS[id]->markers.at(i));
 		}
-		owlTracker(tracker, OWL_ENABLE);
-		if(!owlGetStatus()) {
+		OWL_BACKEND->tracker(tracker, OWL_ENABLE);
+		if(!OWL_BACKEND->getStatus()) {
 			cout << "Error in tracker setup: unable to start tracker " << id 
 				<< " ... will be unlinkable.\n" << flush;
-			sensor->status = false;
+			ALL_SENSORS[id]->setupError = SETUP_ERROR_TRACKER;
 			return;
 		}
 	}
@@ -444,7 +904,38 @@ void SetUpSensor(const int& id) {
 	//mark as started
 	ALL_SENSORS[id]->isStarted = true;
 	ALL_SENSORS[id]->needsInitialization = false;
+	++CONFIG_GENERATION;
+
+}
 
+//Pick the OWL source from the server address (see COwlBackend.h).
+//Returns NULL if the address needs the live server and it was not built in.
+cOwlBackend* CreateOwlBackend(const string& server) {
+	if(server.compare(0, 4, "sim:") == 0) {
+		return new cSyntheticOwlBackend(ParseOwlBackendOptions(server.substr(4)));
+	}
+	if(server.compare(0, 7, "replay:") == 0) {
+		return new cReplayOwlBackend(ParseOwlBackendOptions(server.substr(7)));
+	}
+#if defined(OWL_BACKEND_NO_LIVE)
+	return NULL;
+#else
+	return new cLiveOwlBackend();
+#endif
+}
+
+//Runs on START_THREAD (command 8), which sets START_CONNECTING before starting it.
+//Progress is published in START_STATE, START_SENSORS_*, START_FRAMES and each sensor's
+//setupState for command 29.
+//Size the history rings (command 32) for the frequency, now it is fixed. Called by
+//command 8 before the startup thread exists, on the thread that reads the rings
+//(commands 31 and 33, ReadSensorSamples), so a read never meets a resize.
+void SizeHistories() {
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->historySeconds > 0.0f) {
+			ALL_SENSORS[i]->history.resize(max(2u, (unsigned int)(ALL_SENSORS[i]->historySeconds*LOCAL_OWL_FREQUENCY)));
+		}
+	}
 }
 
 void StartServer() {
@@ -452,11 +943,21 @@ void StartServer() {
 	if(!SERVER_STARTED) {
 		//have to start the server, must be first pass
 		cout << "Starting OWL server ... " << flush;
-		owlInit(OWL_SERVER.c_str(), LOCAL_FLAGS);
-		if(owlGetStatus() == 0) {
+		OWL_BACKEND.reset(CreateOwlBackend(OWL_SERVER));
+		if(!OWL_BACKEND) {
+			cout << "Error: built without the OWL library, only sim: and replay: servers work ... not started\n" << flush;
+			START_STATE = START_FAILED;
+			return;
+		}
+		OWL_BACKEND->init(OWL_SERVER.c_str(), LOCAL_FLAGS);
+		if(OWL_BACKEND->getStatus() == 0) {
 			cout << "Warning: OWL initialization error ... unknown result (may have no effect).\n" << flush;
 			cout << "         Is it possible another program is running PhaseSpace (master)?\n" << flush;
 			cout << "         Be aware that this occasionally just happens (retry)\n" << flush;
+			//let go of the half open connection so a retry starts clean
+			OWL_BACKEND->done();
+			OWL_BACKEND.reset();
+			START_STATE = START_FAILED;
 			return;
 		}
 		cout << "done\n" << flush;
@@ -464,24 +965,113 @@ void StartServer() {
 		GLOBAL_MARKERS = new OWLMarker[MARKER_COUNT];
 		GLOBAL_RIGIDS = new OWLRigid[RIGID_COUNT];
 		if( (LOCAL_FLAGS & OWL_SLAVE) == OWL_SLAVE ) {
-			owlSetFloat(OWL_FREQUENCY, LOCAL_OWL_FREQUENCY);
+			OWL_BACKEND->setFloat(OWL_FREQUENCY, LOCAL_OWL_FREQUENCY);
 		}
 		SERVER_STARTED = true;
 
+		int total = 0;
+		for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+			if(ALL_SENSORS[i]->needsInitialization) {
+				ALL_SENSORS[i]->setupState = SETUP_PENDING;
+				ALL_SENSORS[i]->setupError = SETUP_ERROR_NONE;
+				++total;
+			}
+		}
+		START_SENSORS_DONE = 0;
+		START_SENSORS_TOTAL = total;
+		START_FRAMES = 0;
+
+		//capture the rigid definitions of every sensor that needs one from the same frames
+		START_STATE = START_CALIBRATING;
+		vector<int> pending;
+		for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+			if(ALL_SENSORS[i]->needsInitialization && NeedsRigidLocations(i)) {
+				pending.push_back(i);
+			}
+		}
+		if(!RIGID_CACHE_FILE.empty()) {
+			RIGID_CACHE.load(RIGID_CACHE_FILE);
+			vector<int> uncached;
+			for(int k = 0; k < pending.size(); ++k) {
+				SPhaseSpaceSensor* s = ALL_SENSORS[pending[k]];
+				vector<float> cached;
+				if(RIGID_CACHE.find(OWL_SERVER, s->markers, cached)) {
+					for(int i = 0; i < s->markers.size(); ++i) {
+						float* point = new float[3];
+						memcpy(point, &cached[3*i], 3*sizeof(float));
+						s->rigidBodyDefinition.push_back(point);
+					}
+					cout << "Using the cached rigid body definition for sensor " << pending[k] << "\n" << flush;
+				} else {
+					uncached.push_back(pending[k]);
+				}
+			}
+			pending.swap(uncached);
+		}
+		if(!pending.empty()) {
+			for(int k = 0; k < pending.size(); ++k) {
+				ALL_SENSORS[pending[k]]->setupState = SETUP_CALIBRATING;
+			}
+			vector<vector<float*> > definitions;
+			CreateRigidLocations(pending, definitions);
+			for(int k = 0; k < pending.size(); ++k) {
+				SPhaseSpaceSensor* s = ALL_SENSORS[pending[k]];
+				s->setupState = SETUP_PENDING;
+				s->rigidBodyDefinition = definitions[k];
+				if(!definitions[k].empty()) {
+					vector<float> points;
+					for(int i = 0; i < definitions[k].size(); ++i) {
+						points.insert(points.end(), definitions[k][i], definitions[k][i] + 3);
+					}
+					RIGID_CACHE.store(OWL_SERVER, s->markers, points);
+				}
+			}
+			if(!RIGID_CACHE_FILE.empty() && !RIGID_CACHE.save(RIGID_CACHE_FILE)) {
+				cout << "Warning: could not write the rigid body cache " << RIGID_CACHE_FILE << "\n" << flush;
+			}
+		}
+
 		//check initialization
+		START_STATE = START_CONFIGURING;
 		for(int i = 0; i < ALL_SENSORS.size(); ++i) {
 			if(ALL_SENSORS[i]->needsInitialization) {
 				cout << "Starting phasespace initialization for sensor " << i << " ... " << flush;
+				ALL_SENSORS[i]->setupState = SETUP_CONFIGURING;
 				SetUpSensor(i);
+				ALL_SENSORS[i]->setupState = ALL_SENSORS[i]->isStarted ? SETUP_STARTED : SETUP_FAILED;
+				++START_SENSORS_DONE;
 				cout << "done\n" << flush;
 			}
 		}
 
+		//the pose bus lists every sensor, started or not, so its layout matches user[0]
+		if(!POSE_BUS_NAME.empty()) {
+			vector<SPoseBusSensor> layout(ALL_SENSORS.size());
+			for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+				SPhaseSpaceSensor* s = ALL_SENSORS[i];
+				layout[i].id = i;
+				layout[i].type = s->isRigid ? POSE_BUS_RIGID : s->solve == SENSOR_SOLVE_RIGID ? POSE_BUS_SOLVED_RIGID
+					: s->solve == SENSOR_SOLVE_SEGMENT ? POSE_BUS_SEGMENT : POSE_BUS_POINT;
+				layout[i].markerCount = s->markers.size();
+				layout[i].firstMarker = s->markers.empty() ? -1 : s->markers[0];
+			}
+			if(POSE_BUS.create(POSE_BUS_NAME, layout, LOCAL_OWL_FREQUENCY)) {
+				cout << "Publishing poses to shared memory " << POSE_BUS_NAME << "\n" << flush;
+			} else {
+				cout << "Warning: could not make the pose bus " << POSE_BUS_NAME << " ... not publishing\n" << flush;
+			}
+		}
+
 		//start up the read thread
 		SetOwlStreaming(true);
+		READ_STARTED = true;
 		READ_THREAD.reset(new boost::thread(threadMe));
+#if defined(_WIN32)
 		SetThreadPriority(READ_THREAD->native_handle(), THREAD_PRIORITY_HIGHEST);
+#endif
 	}
+	//everything above is visible to the render thread once it sees this
+	START_STATE = START_STREAMING;
 }
 
 void QuerySensor(void *sensor)
@@ -508,7 +1098,7 @@ void InitializeSensor(void *sensor)
 	//This function will attempt to connect to the device and initialize any variables.
 
 	//Check if the server is already started
-	if(SERVER_STARTED) {
+	if(SERVER_STARTED || ServerStarting()) {
 		cout << "Error: cannot add PhaseSpace markers after starting the server ... skipping\n" << flush;
 		((VRUTSensorObj *)sensor)->status = false;
 		return;
@@ -521,7 +1111,8 @@ void InitializeSensor(void *sensor)
 	//can get those values by calling the "get" command on the
 	//sensor object in the script.
 	//It is suggested that the size of the data field be 7 or higher
-	((VRUTSensorObj*)sensor)->dataSize = 7;
+	//Fields past the pose carry answers to commands (see SetReply).
+	((VRUTSensorObj*)sensor)->dataSize = POSE_FIELDS + REPLY_SIZE;
 
 	//If you have multiple instances you can store your own unique
 	//identifier in the user data fields.
@@ -535,6 +1126,34 @@ void InitializeSensor(void *sensor)
 	newSensor->isRigid = false;
 	newSensor->trackerID = ALL_SENSORS.size();
 	newSensor->samples = 0;
+	newSensor->stream = NULL;
+	newSensor->dumpState = DUMP_NONE;
+	newSensor->dumpWritten = 0;
+	newSensor->dumpTotal = 0;
+	newSensor->dumpSequence = 0;
+	newSensor->dumpsPending = 0;
+	newSensor->hasCalibration = false;
+	newSensor->lastArrival = -1.0;
+	newSensor->predictMode = PREDICT_HOLD;
+	newSensor->predictHorizon = 0.0f;
+	newSensor->filter.type = POSE_FILTER_NONE;
+	newSensor->filter.a = 0.0f;
+	newSensor->filter.b = 0.0f;
+	newSensor->filter.c = 0.0f;
+	newSensor->solve = SENSOR_SOLVE_NONE;
+	newSensor->gapFill = false;
+	newSensor->gapFillLimit = 0.1f;
+	newSensor->setupState = SETUP_NONE;
+	newSensor->setupError = SETUP_ERROR_NONE;
+	newSensor->shownGeneration = 0;
+	newSensor->shownArrival = -1.0;
+	newSensor->historySeconds = 0.0f;
+	newSensor->ttlWindow.pre = 0.0f;
+	newSensor->ttlWindow.post = 0.0f;
+	newSensor->ttlWindow.lines = 1;
+	newSensor->ttlWindow.edge = TTL_EDGE_RISING;
+	newSensor->ttlWindow.decimation = 0;
+	newSensor->ttlRecording = false;
 	ALL_SENSORS.push_back(newSensor);
 
 	cout << "Added sensor id " << newSensor->trackerID << "\n" << flush;
@@ -543,6 +1162,51 @@ void InitializeSensor(void *sensor)
 }
 
 
+//true once the read thread is publishing poses (the startup thread owns everything until then)
+bool PosesPublished() {
+	return START_STATE == START_STREAMING && SERVER_STARTED && STREAMING && READ_STARTED;
+}
+
+//Vizard thread, after a start: a sensor that could not be set up gets status false. The
+//startup thread only leaves setupState, the status field is Vizard's.
+void ShowSetupStatus() {
+	if(START_STATE != START_STREAMING) {
+		return;
+	}
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->setupState == SETUP_FAILED) {
+			ALL_SENSORS[i]->instance->status = false;
+		}
+	}
+}
+
+//Copy a sensor's published pose (already in Vizard coordinates) to its data fields, Vizard
+//thread only. No lock, the seqlock gives a consistent copy of the last published frame, and
+//the copy is skipped while nothing new has been published unless the pose is predicted (it
+//moves on with the clock).
+void ShowPose(SPhaseSpaceSensor* s, const double& now) {
+	bool predicting = s->predictMode != PREDICT_HOLD;
+	if(predicting || s->published.generation() != s->shownGeneration) {
+		SPoseSnapshot snapshot;
+		s->shownGeneration = s->published.read(snapshot);
+		s->shownArrival = snapshot.samples > 0 ? snapshot.arrival : -1.0;
+		if(predicting && snapshot.samples > 0) {
+			//move the pose on to when it will be seen
+			float predicted[7];
+			cPosePredictor::extrapolate(snapshot.pose, snapshot.rates, s->predictMode,
+				now - snapshot.arrival + s->predictHorizon, predicted);
+			memcpy(snapshot.pose, predicted, sizeof(predicted));
+		}
+		for(int k = 0; k < POSE_FIELDS; ++k) {
+			s->instance->data[k] = snapshot.pose[k];
+		}
+	}
+	//how stale the pose is as Vizard gets it
+	if(s->shownArrival >= 0.0) {
+		s->latency.record(now - s->shownArrival);
+	}
+}
+
 void UpdateSensor(void *sensor)
 {
 	// Update the sensor data fields (see sensor.h)
@@ -557,140 +1221,552 @@ void UpdateSensor(void *sensor)
 	// the data fields with whatever you want and retrieve it with the "<sensor>.get()" command
 	// in your script.
 
-	//wait for the server to be started
-	if(!SERVER_STARTED) {
+	//Only the calling sensor (user[0]), Vizard calls this once per instance per frame.
+	if(!PosesPublished()) {
 		return;
 	}
+	double now = simClock.getCPUTimeSeconds();
+	int id = ((VRUTSensorObj *)sensor)->user[0];
+	if(id >= 0 && id < ALL_SENSORS.size() && ALL_SENSORS[id]->isStarted) {
+		ShowPose(ALL_SENSORS[id], now);
+	}
+	UPDATE_COST.record(simClock.getCPUTimeSeconds() - now);
+}
 
-	//check streaming status
-	if(!STREAMING) {
+//Every started sensor's data fields in one call, for scripts that read the poses together
+//(command 30, or call the export directly, e.g. through ctypes).
+void UpdateAllSensors()
+{
+	if(!PosesPublished()) {
 		return;
 	}
+	double now = simClock.getCPUTimeSeconds();
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->isStarted) {
+			ShowPose(ALL_SENSORS[i], now);
+		}
+	}
+	UPDATE_COST.record(simClock.getCPUTimeSeconds() - now);
+}
 
-	if(READ_THREAD) {
-		//lock then update the position
-		boost::mutex::scoped_lock l(block_mutex);
+//Every sample of a sensor (the id in user[0]) since the last call, oldest first, up to
+//maxCount into out (see CPoseHistory.h for the layout, e.g. a ctypes Structure array).
+//Returns the count, or -1 for an unknown sensor. Call from one thread only, the one
+//sending commands (the script's).
+int ReadSensorSamples(int sensor, SPoseSample* out, int maxCount)
+{
+	if(sensor < 0 || sensor >= ALL_SENSORS.size() || out == NULL || maxCount < 0) {
+		return -1;
+	}
+	//nothing is recorded until the read thread runs
+	if(ServerStarting()) {
+		return 0;
+	}
+	return int(ALL_SENSORS[sensor]->history.readNew(out, (unsigned int) maxCount));
+}
 
-		for(int i = 0; i < ALL_SENSORS.size(); ++i) {
-			if(ALL_SENSORS[i]->isStarted) {
-				if(ALL_SENSORS[i]->isRigid) {
-					//handle rigids here
-					ALL_SENSORS[i]->instance->data[0] = -1.0f * SCALE_X * ( ALL_SENSORS[i]->lastGood[0] + OFFSET_X );
-					ALL_SENSORS[i]->instance->data[1] = SCALE_Y * ( ALL_SENSORS[i]->lastGood[1] + OFFSET_Y );
-					ALL_SENSORS[i]->instance->data[2] = SCALE_Z * ( ALL_SENSORS[i]->lastGood[2] + OFFSET_Z );
-					ALL_SENSORS[i]->instance->data[3] = -1.0f * ALL_SENSORS[i]->lastGood[4];
-					ALL_SENSORS[i]->instance->data[4] = ALL_SENSORS[i]->lastGood[5];
-					ALL_SENSORS[i]->instance->data[5] = ALL_SENSORS[i]->lastGood[6];
-					ALL_SENSORS[i]->instance->data[6] = -1.0f * ALL_SENSORS[i]->lastGood[3];
-				} else {
-					ALL_SENSORS[i]->instance->data[0] = -1.0f * SCALE_X * ( ALL_SENSORS[i]->lastGood[0] + OFFSET_X );
-					ALL_SENSORS[i]->instance->data[1] = SCALE_Y * ( ALL_SENSORS[i]->lastGood[1] + OFFSET_Y );
-					ALL_SENSORS[i]->instance->data[2] = SCALE_Z * ( ALL_SENSORS[i]->lastGood[2] + OFFSET_Z );
-					ALL_SENSORS[i]->instance->data[3] = 0.0f;
-					ALL_SENSORS[i]->instance->data[4] = 0.0f;
-					ALL_SENSORS[i]->instance->data[5] = 0.0f;
-					ALL_SENSORS[i]->instance->data[6] = 1.0f;
-				}
+//One line of JSON with the throughput counters since the plugin started, appended per
+//report so a file collects one line per run (or per check point) for comparing versions.
+//Times in microseconds unless the name says otherwise.
+void WritePerfReport(ostream& out) {
+	double now = simClock.getCPUTimeSeconds();
+	int started = 0, rigids = 0;
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->isStarted) {
+			++started;
+			rigids += ALL_SENSORS[i]->isRigid ? 1 : 0;
+		}
+	}
+	string server;
+	for(int i = 0; i < OWL_SERVER.size(); ++i) {
+		if(OWL_SERVER[i] == '"' || OWL_SERVER[i] == '\\') {
+			server.push_back('\\');
+		}
+		server.push_back(OWL_SERVER[i]);
+	}
+	double elapsed = READ_STARTED ? now - READ_START : 0.0;
+	unsigned long frames = READ_FRAMES.load(boost::memory_order_relaxed);
+	double streamSeconds = 1.0e-9*double(STREAM_BUSY_NS.load(boost::memory_order_relaxed));
+	unsigned long streamed = STREAM_SAMPLES.load(boost::memory_order_relaxed);
+	double dumpSeconds = 1.0e-9*double(DUMP_BUSY_NS.load(boost::memory_order_relaxed));
+	unsigned long dumped = DUMP_SAMPLES.load(boost::memory_order_relaxed);
+
+	out.precision(6);
+	out << "{\"server\": \"" << server << "\""
+		<< ", \"frequency\": " << LOCAL_OWL_FREQUENCY
+		<< ", \"wait_mode\": " << READ_WAIT_MODE
+		<< ", \"lane_width\": " << cPoseTransformBatch::laneWidth()
+		<< ", \"sensors\": " << started
+		<< ", \"rigids\": " << rigids
+		<< ", \"markers\": " << MARKER_COUNT
+		<< ", \"elapsed_s\": " << elapsed
+		<< ", \"frames\": " << frames
+		<< ", \"frames_per_s\": " << (elapsed > 0.0 ? double(frames)/elapsed : 0.0)
+		<< ", \"frame_us_p50\": " << 1.0e6*PUBLISH_LATENCY.percentile(0.5)
+		<< ", \"frame_us_p99\": " << 1.0e6*PUBLISH_LATENCY.percentile(0.99)
+		<< ", \"frame_us_max\": " << 1.0e6*PUBLISH_LATENCY.maximum()
+		<< ", \"solve_us_p50\": " << 1.0e6*SOLVE_COST.percentile(0.5)
+		<< ", \"solve_us_max\": " << 1.0e6*SOLVE_COST.maximum()
+		<< ", \"update_calls\": " << UPDATE_COST.count()
+		<< ", \"update_us_p50\": " << 1.0e6*UPDATE_COST.percentile(0.5)
+		<< ", \"update_us_p99\": " << 1.0e6*UPDATE_COST.percentile(0.99)
+		<< ", \"update_us_max\": " << 1.0e6*UPDATE_COST.maximum()
+		<< ", \"stream_samples\": " << streamed
+		<< ", \"stream_samples_per_s\": " << (streamSeconds > 0.0 ? double(streamed)/streamSeconds : 0.0)
+		<< ", \"dump_samples\": " << dumped
+		<< ", \"dump_s_per_million\": " << (dumped > 0 ? 1.0e6*dumpSeconds/double(dumped) : 0.0)
+		<< "}\n" << flush;
+}
+
+//What the read thread works from each frame. Rebuilt only when CONFIG_GENERATION
+//changes, so the frame loop never walks inactive sensors or re-branches on the
+//sensor type. Slots are compact, rigids first, then sensors solved from their
+//markers (or gap filled), then point markers, and the transform batch uses the same slots.
+struct SReadTables {
+	vector<int> sensor;           //slot -> index in ALL_SENSORS
+	vector<int> source;           //slot -> rigid number (rigids) or (first) marker id
+	int rigidCount;               //slots [0, rigidCount) are rigids
+	int pointStart;               //slots [rigidCount, pointStart) are solved from markers, the rest are points
+	SClockMapping clock;          //plugin time -> vizard tick for recorded samples
+};
+
+//Fill the slots from ALL_SENSORS (read thread only, under config_mutex).
+void BuildReadSlots(SReadTables& tables) {
+	tables.sensor.clear();
+	tables.source.clear();
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->isStarted && ALL_SENSORS[i]->isRigid) {
+			tables.sensor.push_back(i);
+			tables.source.push_back(ALL_SENSORS[i]->rigidNumber);
+		}
+	}
+	tables.rigidCount = tables.sensor.size();
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		SPhaseSpaceSensor* s = ALL_SENSORS[i];
+		if(s->isStarted && !s->isRigid && (s->solve != SENSOR_SOLVE_NONE || s->gapFill)) {
+			tables.sensor.push_back(i);
+			tables.source.push_back(s->markers[0]);
+		}
+	}
+	tables.pointStart = tables.sensor.size();
+	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+		if(ALL_SENSORS[i]->isStarted && !ALL_SENSORS[i]->isRigid && ALL_SENSORS[i]->solve == SENSOR_SOLVE_NONE
+			&& !ALL_SENSORS[i]->gapFill) {
+			tables.sensor.push_back(i);
+			tables.source.push_back(ALL_SENSORS[i]->markers[0]);
+		}
+	}
+}
+
+//Rebuild the tables and load every active sensor's calibration and filter (read thread only).
+//Sensors without their own calibration follow the global SCALE and OFFSET.
+void BuildReadTables(SReadTables& tables, cPoseTransformBatch& transform, cPoseFilterBatch& filter) {
+	boost::mutex::scoped_lock l(config_mutex);
+	BuildReadSlots(tables);
+	tables.clock = CLOCK_SYNC.mapping();
+
+	float scale[3] = {SCALE_X, SCALE_Y, SCALE_Z};
+	float offset[3] = {OFFSET_X, OFFSET_Y, OFFSET_Z};
+	float m[12];
+	transform.resize(tables.sensor.size());
+	filter.resize(tables.sensor.size());
+	for(int slot = 0; slot < tables.sensor.size(); ++slot) {
+		SPhaseSpaceSensor* s = ALL_SENSORS[tables.sensor[slot]];
+		if(s->hasCalibration) {
+			transform.setCalibration(slot, s->calibration);
+		} else {
+			cPoseTransformBatch::defaultCalibration(m, scale, offset);
+			transform.setCalibration(slot, m);
+		}
+		filter.configure(slot, tables.sensor[slot], s->filter);
+		s->ttlWindower.configure(s->ttlWindow, LOCAL_OWL_FREQUENCY);
+		if(s->gapFill && !s->isRigid) {
+			//the rigid definition is fixed once the sensor is started
+			vector<float> geometry;
+			for(int k = 0; k < s->rigidBodyDefinition.size() && s->rigidBodyDefinition.size() == s->markers.size(); ++k) {
+				geometry.insert(geometry.end(), s->rigidBodyDefinition[k], s->rigidBodyDefinition[k] + 3);
 			}
+			s->gapFiller.configure(s->markers.size(), geometry.empty() ? NULL : &geometry[0], s->gapFillLimit);
 		}
 	}
 }
 
+//Pose of a sensor solved from this frame's markers, OWLRigid::pose layout (read thread only).
+//Lost markers are filled in first if the sensor asks for it, flags says how (ERecordFlags).
+//t is when OWL took the frame. Returns the cond to use: 1 if solved, -1 (pose left at the
+//last solution) if not.
+float SolveSensorPose(SPhaseSpaceSensor* s, const double& t, float pose[7], unsigned int& flags) {
+	float observed[3*MAX_MARKER_COUNT];
+	float weights[MAX_MARKER_COUNT];
+	for(int i = 0; i < s->markers.size(); ++i) {
+		const OWLMarker& marker = GLOBAL_MARKERS[s->markers[i]];
+		observed[3*i] = marker.x;
+		observed[3*i + 1] = marker.y;
+		observed[3*i + 2] = marker.z;
+		weights[i] = marker.cond > 0.1f ? marker.cond : 0.0f;
+	}
+	//flag the sample only if the pose needed the filled markers
+	int seen = 0;
+	for(int i = 0; i < s->markers.size(); ++i) {
+		seen += weights[i] > 0.0f ? 1 : 0;
+	}
+	bool needed = s->solve == SENSOR_SOLVE_NONE ? weights[0] <= 0.0f
+		: s->solve == SENSOR_SOLVE_RIGID ? seen < 3 : seen < s->markers.size();
+	flags = s->gapFill ? s->gapFiller.fill(observed, weights, t) : 0;
+	if(!needed) {
+		flags = 0;
+	}
+	if(s->solve == SENSOR_SOLVE_NONE) {
+		//a point marker, only here to be filled in
+		pose[0] = observed[0]; pose[1] = observed[1]; pose[2] = observed[2];
+		pose[3] = 1.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 0.0f;
+		return weights[0] > 0.0f ? 1.0f : -1.0f;
+	}
+	if(s->solve == SENSOR_SOLVE_SEGMENT) {
+		//orientation is added after the mapping to Vizard (see threadMe)
+		pose[3] = 1.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 0.0f;
+		return s->segmentSolver.solve(observed, weights, s->markers.size(), pose) ? 1.0f : -1.0f;
+	}
+	float rms;
+	return s->rigidSolver.solve(observed, weights, pose, rms) ? 1.0f : -1.0f;
+}
+
+//Hand the last good measurement to UpdateSensor (read thread only).
+//arrival is when its OWL frame reached the read thread.
+void PublishLastGood(SPhaseSpaceSensor* s, const double& arrival) {
+	SPoseSnapshot snapshot;
+	memcpy(snapshot.pose, s->lastGood, sizeof(snapshot.pose));
+	snapshot.samples = s->samples;
+	snapshot.arrival = arrival;
+	snapshot.rates = s->predictor.rates();
+	s->published.publish(snapshot);
+}
+
 //this will be put into a thread (just pulled out of the old UpdateSensor command)
 void threadMe() {
 	dataRecordMember insert;
+	cReadWait wait;
+	wait.setMode(READ_WAIT_MODE, LOCAL_OWL_FREQUENCY, READ_WAIT_MARGIN, simClock.getCPUTimeSeconds());
+	cPoseTransformBatch transform;
+	cPoseFilterBatch filter;
+	SReadTables tables;
+	unsigned int configGeneration = CONFIG_GENERATION - 1;   //forces the first build
+	float pose[7];
+	vector<bool> goodSlot;                                   //slots with a good sample this frame
+	vector<float> solvedCond;                                //cond of the slots solved from markers
+	vector<unsigned int> solvedFlags;                        //and how they were solved (ERecordFlags)
+	vector<SPoseBusEntry> busEntries(ALL_SENSORS.size());    //every sensor's latest sample for the pose bus
+	vector<dataRecordMember> kept;                           //samples a sensor records this frame
+	STtlWindow window;
+	for(int i = 0; i < busEntries.size(); ++i) {
+		memset(&busEntries[i], 0, sizeof(SPoseBusEntry));
+		busEntries[i].pose[6] = 1.0f;
+		busEntries[i].cond = -1.0f;
+	}
+	READ_START = simClock.getCPUTimeSeconds();
 	while(true) {
 
+		//handle requests (simple callback functionality)
+		if(REQUEST_READ_WAIT_CHANGE) {
+			REQUEST_READ_WAIT_CHANGE = false;
+			wait.setMode(READ_WAIT_MODE, LOCAL_OWL_FREQUENCY, READ_WAIT_MARGIN, simClock.getCPUTimeSeconds());
+		}
+		if(REQUEST_READ_WAIT_REPORT) {
+			REQUEST_READ_WAIT_REPORT = false;
+			wait.report(cout, simClock.getCPUTimeSeconds());
+		}
+		if(configGeneration != CONFIG_GENERATION) {
+			configGeneration = CONFIG_GENERATION;
+			BuildReadTables(tables, transform, filter);
+		}
+
 		//if(ALL_SENSORS[0]->requestRecording) {
 		//	counterHack.push_back(simClock.getCPUTimeSeconds());
 		//}
 
 		//update if the sensor has data
 		unsigned char buffer[1024];
-		int n = owlGetMarkers(GLOBAL_MARKERS, MARKER_COUNT);
-		int m = owlGetRigids(GLOBAL_RIGIDS, RIGID_COUNT);
+		int n = OWL_BACKEND->getMarkers(GLOBAL_MARKERS, MARKER_COUNT);
+		int m = OWL_BACKEND->getRigids(GLOBAL_RIGIDS, RIGID_COUNT);
+		//one clock read per frame, shared by every sensor in it
+		double pollTime = simClock.seconds(simClock.ticks());
 		if(n>0 || m>0) {
-			//lock then read the position (shouldn't take very long)
-			boost::mutex::scoped_lock l(block_mutex);
+			double frameTime = tables.clock.map(pollTime);
+			//the lock only guards the records, take it on the first recording sensor
+			//(poses go out through the seqlock so UpdateSensor never holds us up)
+			boost::mutex::scoped_lock l(block_mutex, boost::defer_lock);
+
+			OWL_BACKEND->getString(OWL_COMMDATA, (char*)buffer);
+
+#if defined(READ_LOOP_WALK_ALL_SENSORS)
+			//the walk over every sensor each frame from before the tables, kept so the
+			//read loop benchmark can measure both (tests/Makefile builds it this way too)
+			{
+				boost::mutex::scoped_lock c(config_mutex);
+				BuildReadSlots(tables);
+			}
+#endif
+			//handle requests (simple callback functionality)
+			if(REQUEST_RESET_ORIGIN && ORIGIN_ID < ALL_SENSORS.size() && ALL_SENSORS[ORIGIN_ID]->isStarted) {
+				SPhaseSpaceSensor* s = ALL_SENSORS[ORIGIN_ID];
+				if(s->isRigid && m > 0) {
+					OFFSET_X = -1.0f*GLOBAL_RIGIDS[s->rigidNumber].pose[0];
+					OFFSET_Y = -1.0f*GLOBAL_RIGIDS[s->rigidNumber].pose[1];
+					OFFSET_Z = -1.0f*GLOBAL_RIGIDS[s->rigidNumber].pose[2];
+					REQUEST_RESET_ORIGIN = false;
+				} else if(!s->isRigid && n > 0) {
+					OFFSET_X = -1.0f*GLOBAL_MARKERS[s->markers[0]].x;
+					OFFSET_Y = -1.0f*GLOBAL_MARKERS[s->markers[0]].y;
+					OFFSET_Z = -1.0f*GLOBAL_MARKERS[s->markers[0]].z;
+					REQUEST_RESET_ORIGIN = false;
+				}
+				if(!REQUEST_RESET_ORIGIN) {
+					configGeneration = ++CONFIG_GENERATION;
+					BuildReadTables(tables, transform, filter);
+				}
+			}
+
+			//gather this frame's raw poses and map them all to Vizard in one batch
+			//(only the slots whose source updated: rigids if m > 0, markers if n > 0)
+			int slots = tables.sensor.size();
+			int first = m > 0 ? 0 : tables.rigidCount;
+			int last = n > 0 ? slots : tables.rigidCount;
+			for(int slot = first; slot < tables.rigidCount; ++slot) {
+				transform.setInput(slot, GLOBAL_RIGIDS[tables.source[slot]].pose);
+			}
+			solvedCond.resize(slots, -1.0f);
+			solvedFlags.resize(slots, 0);
+			if(n > 0 && tables.pointStart > tables.rigidCount) {
+				tClockTicks solveStart = simClock.ticks();
+				for(int slot = tables.rigidCount; slot < tables.pointStart; ++slot) {
+					float solved[7];
+					double taken = double(GLOBAL_MARKERS[tables.source[slot]].frame)/LOCAL_OWL_FREQUENCY;
+					solvedCond[slot] = SolveSensorPose(ALL_SENSORS[tables.sensor[slot]], taken, solved, solvedFlags[slot]);
+					transform.setInput(slot, solved);
+				}
+				SOLVE_COST.record(simClock.elapsed(solveStart, simClock.ticks())/double(tables.pointStart - tables.rigidCount));
+			}
+			for(int slot = max(first, tables.pointStart); slot < last; ++slot) {
+				const OWLMarker& marker = GLOBAL_MARKERS[tables.source[slot]];
+				transform.setInput(slot, marker.x, marker.y, marker.z);
+			}
+			transform.apply();
+			goodSlot.resize(slots, false);
+
+			for(int slot = first; slot < last; ++slot) {
+				SPhaseSpaceSensor* s = ALL_SENSORS[tables.sensor[slot]];
+				transform.getOutput(slot, pose);
+				float cond;
+				int frame;
+				if(slot < tables.rigidCount) {
+					cond = GLOBAL_RIGIDS[tables.source[slot]].cond;
+					frame = GLOBAL_RIGIDS[tables.source[slot]].frame;
+				} else if(slot < tables.pointStart) {
+					cond = solvedCond[slot];
+					frame = GLOBAL_MARKERS[tables.source[slot]].frame;
+					if(s->solve == SENSOR_SOLVE_SEGMENT) {
+						float direction[3];
+						transform.mapDirection(slot, s->segmentSolver.direction(), direction);
+						s->segmentSolver.orientation(direction, pose + 3);
+					} else if(s->solve == SENSOR_SOLVE_NONE) {
+						pose[3] = 0.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 1.0f;
+					}
+				} else {
+					//point markers have no orientation
+					pose[3] = 0.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 1.0f;
+					cond = GLOBAL_MARKERS[tables.source[slot]].cond;
+					frame = GLOBAL_MARKERS[tables.source[slot]].frame;
+				}
 
-			owlGetString(OWL_COMMDATA, (char*)buffer);
+				unsigned int flags = slot >= tables.rigidCount && slot < tables.pointStart ? solvedFlags[slot] : 0;
+				SPoseSample sample;
+				sample.time = frameTime;
+				memcpy(sample.pose, pose, sizeof(pose));
+				sample.cond = cond;
+				sample.ttl = PacketTtl(buffer);
+				sample.flags = flags;
+				s->history.push(sample);
+				if(POSE_BUS.isOpen()) {
+					SPoseBusEntry& entry = busEntries[tables.sensor[slot]];
+					memcpy(entry.pose, pose, sizeof(pose));
+					entry.cond = cond;
+					entry.ttl = sample.ttl;
+					entry.flags = flags;
+				}
 
-			for(int i = 0; i < ALL_SENSORS.size(); ++i) {
-				if(ALL_SENSORS[i]->isStarted) {
-					if(ALL_SENSORS[i]->isRigid) {
-						//handle rigids here
-						int rigidNumber = ALL_SENSORS[i]->rigidNumber;
-						if(m > 0) {
-							//handle requests (simple callback functionality)
-							if(REQUEST_RESET_ORIGIN && ORIGIN_ID == i) {
-								OFFSET_X = -1.0f*GLOBAL_RIGIDS[rigidNumber].pose[0];
-								OFFSET_Y = -1.0f*GLOBAL_RIGIDS[rigidNumber].pose[1];
-								OFFSET_Z = -1.0f*GLOBAL_RIGIDS[rigidNumber].pose[2];
-								REQUEST_RESET_ORIGIN = false;
-							}
-							if(ALL_SENSORS[i]->requestRecording) {
-								insert.time = simClock.getCPUTimeSeconds()+timeOffset;
-								insert.ttl = ((packet*)buffer)->ttl_0;
-								insert.x = -1.0 * SCALE_X * ( GLOBAL_RIGIDS[rigidNumber].pose[0] + OFFSET_X );
-								insert.y = SCALE_Y * ( GLOBAL_RIGIDS[rigidNumber].pose[1] + OFFSET_Y );
-								insert.z = SCALE_Z * ( GLOBAL_RIGIDS[rigidNumber].pose[2] + OFFSET_Z );
-								insert.qw = -1.0 * GLOBAL_RIGIDS[rigidNumber].pose[4];
-								insert.qx = GLOBAL_RIGIDS[rigidNumber].pose[5];
-								insert.qy = GLOBAL_RIGIDS[rigidNumber].pose[6];
-								insert.qz = -1.0 * GLOBAL_RIGIDS[rigidNumber].pose[3];
-								ALL_SENSORS[i]->record.push_back(insert);
-							}
-							//store this as the last good estimate
-							if(GLOBAL_RIGIDS[rigidNumber].cond > 0.1f) {
-								ALL_SENSORS[i]->samples += 1;
-								for(int k = 0; k < 7; ++k) {
-									ALL_SENSORS[i]->lastGood[k] = GLOBAL_RIGIDS[rigidNumber].pose[k];
-								}
+				cStreamRecorder* stream = s->stream.load(boost::memory_order_acquire);
+				bool streaming = stream != NULL && stream->isRecording();
+				bool recording = s->requestRecording || streaming;
+				if(recording != s->ttlRecording) {
+					//TTL windows do not carry over a pause, one still open ends with the recording
+					s->ttlRecording = recording;
+					if(recording) {
+						s->ttlWindower.restart();
+					} else {
+						s->ttlWindower.finish();
+						if(s->ttlWindower.takeClosed(window)) {
+							if(!l.owns_lock()) {
+								l.lock();
 							}
+							s->windows.push_back(window);
 						}
+					}
+				}
+				if(recording) {
+					insert.time = frameTime;
+					insert.ttl = sample.ttl;
+					insert.flags = flags;
+					insert.x = pose[0];
+					insert.y = pose[1];
+					insert.z = pose[2];
+					//the orientation is kept in Vizard order (data[3..6]) as it always was
+					insert.qx = pose[3];
+					insert.qy = pose[4];
+					insert.qz = pose[5];
+					insert.qw = pose[6];
+					//everything, or only what the TTL windows keep
+					kept.clear();
+					if(s->ttlWindower.active()) {
+						s->ttlWindower.add(insert, kept);
 					} else {
-						//handle point markers here
-						if(n > 0) {
-							int id = ALL_SENSORS[i]->markers[0];
-							if(REQUEST_RESET_ORIGIN && ORIGIN_ID == i) {
-								OFFSET_X = -1.0f*GLOBAL_MARKERS[id].x;
-								OFFSET_Y = -1.0f*GLOBAL_MARKERS[id].y;
-								OFFSET_Z = -1.0f*GLOBAL_MARKERS[id].z;
-								REQUEST_RESET_ORIGIN = false;
-							}
-							if(ALL_SENSORS[i]->requestRecording) {
-								insert.time = simClock.getCPUTimeSeconds()+timeOffset;
-								insert.ttl =  ((packet*)buffer)->ttl_0;
-								insert.x = -1.0f * SCALE_X * ( GLOBAL_MARKERS[id].x + OFFSET_X );
-								insert.y = SCALE_Y * ( GLOBAL_MARKERS[id].y + OFFSET_Y );
-								insert.z = SCALE_Z * ( GLOBAL_MARKERS[id].z + OFFSET_Z );
-								ALL_SENSORS[i]->record.push_back(insert);
-							}
-							if( GLOBAL_MARKERS[id].cond > 0.1 ) {
-								ALL_SENSORS[i]->samples += 1;
-								ALL_SENSORS[i]->lastGood[0] = GLOBAL_MARKERS[id].x;
-								ALL_SENSORS[i]->lastGood[1] = GLOBAL_MARKERS[id].y;
-								ALL_SENSORS[i]->lastGood[2] = GLOBAL_MARKERS[id].z;
-							}
+						kept.push_back(insert);
+					}
+					bool closed = s->ttlWindower.takeClosed(window);
+					if((s->requestRecording && !kept.empty()) || closed) {
+						if(!l.owns_lock()) {
+							l.lock();
+						}
+						if(s->requestRecording) {
+							s->record.insert(s->record.end(), kept.begin(), kept.end());
+						}
+						if(closed) {
+							s->windows.push_back(window);
 						}
 					}
+					if(streaming) {
+						for(int k = 0; k < kept.size(); ++k) {
+							stream->record(kept[k]);
+						}
+					}
+				}
+
+				//store this as the last good estimate
+				if(cond > 0.1f) {
+					s->samples += 1;
+					memcpy(s->lastGood, pose, sizeof(pose));
+					if(s->predictMode != PREDICT_HOLD) {
+						//rates from when OWL took the frame, not when it arrived
+						s->predictor.update(double(frame)/LOCAL_OWL_FREQUENCY, pose);
+					}
+					if(filter.active(slot)) {
+						filter.setInput(slot, pose, double(frame)/LOCAL_OWL_FREQUENCY);
+					}
+					if(s->lastArrival >= 0.0) {
+						s->interval.record(pollTime - s->lastArrival);
+					}
+					s->lastArrival = pollTime;
+					goodSlot[slot] = true;
 				}
 			}
+
+			//smooth every filtered sensor in one pass, then publish
+			filter.apply();
+			for(int slot = first; slot < last; ++slot) {
+				if(goodSlot[slot]) {
+					SPhaseSpaceSensor* s = ALL_SENSORS[tables.sensor[slot]];
+					if(filter.active(slot)) {
+						filter.getOutput(slot, s->lastGood);
+					}
+					PublishLastGood(s, pollTime);
+					goodSlot[slot] = false;
+				}
+			}
+			if(POSE_BUS.isOpen() && !busEntries.empty()) {
+				POSE_BUS.publish(frameTime, &busEntries[0]);
+			}
+			PUBLISH_LATENCY.record(simClock.getCPUTimeSeconds() - pollTime);
+			READ_FRAMES.store(READ_FRAMES.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
 		}
 
+		//tells the writer thread we are past this poll (see cStreamRecorder::drain)
+		++READ_EPOCH;
+
 		if(REQUEST_SHUTDOWN) {
 			return;
 		}
 
+		wait.afterPoll(n>0 || m>0, pollTime);
+	}
+}
+
+//Moves streamed samples from the recorders' rings to their files.
+//Keeps going after a shutdown request until every recorder has finished its file.
+void writerThreadMe() {
+	vector<dataRecordMember> scratch(STREAM_CHUNK_SIZE);
+	while(true) {
+		unsigned int written = 0;
+		bool idle = true;
+		double started = simClock.getCPUTimeSeconds();
+		{
+			boost::mutex::scoped_lock l(stream_mutex);
+			bool readerStopped = !READ_STARTED || REQUEST_SHUTDOWN;
+			unsigned int epoch = READ_EPOCH;
+			for(int i = 0; i < STREAM_RECORDERS.size(); ++i) {
+				if(REQUEST_WRITER_SHUTDOWN) {
+					STREAM_RECORDERS[i]->stop(epoch);
+				}
+				written += STREAM_RECORDERS[i]->drain(epoch, readerStopped, &scratch[0], STREAM_CHUNK_SIZE);
+				idle = idle && STREAM_RECORDERS[i]->state() == STREAM_IDLE;
+			}
+		}
+		if(written > 0) {
+			STREAM_SAMPLES.fetch_add(written, boost::memory_order_relaxed);
+			STREAM_BUSY_NS.fetch_add(boost::uint64_t(1.0e9*(simClock.getCPUTimeSeconds() - started)), boost::memory_order_relaxed);
+		}
+		if(REQUEST_WRITER_SHUTDOWN && idle) {
+			return;
+		}
+		if(written == 0) {
+			boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+		}
 	}
 }
 
+//Start streaming the sensor's samples to a file (same formats as DoDumpFile).
+void StartStreamRecording(const int& id, const char* name, const bool& text) {
+	boost::mutex::scoped_lock l(stream_mutex);
+	cStreamRecorder* stream = ALL_SENSORS[id]->stream.load();
+	if(stream == NULL) {
+		stream = new cStreamRecorder(STREAM_RING_SIZE);
+		STREAM_RECORDERS.push_back(stream);
+		ALL_SENSORS[id]->stream.store(stream, boost::memory_order_release);
+	}
+	if(stream->state() != STREAM_IDLE) {
+		cout << "Error: sensor " << id << " is still streaming to disk ... stop it first (command 106)\n" << flush;
+		return;
+	}
+	SRecordFileInfo info;
+	FillRecordFileInfo(id, info);
+	if(!stream->start(name, info, !text)) {
+		cout << "Error: could not open " << name << " for streaming ... ignoring\n" << flush;
+		return;
+	}
+	if(!WRITER_THREAD) {
+		WRITER_THREAD.reset(new boost::thread(writerThreadMe));
+	}
+}
 
 void ResetSensor(void *sensor)
 {
 	// If the user were to send a reset command, do whatever makes sense to do.
 }
 
+//Commands taken while the startup thread runs (only when command 8 did not wait for it):
+//they do not touch the server or the sensors' setup, or, for 8, wait for the start.
+bool StartupCommandAllowed(const int& command) {
+	return command == 8 || command == 29 || command == 110 || command == 114 || command == 115;
+}
+
 void CommandSensor(void *sensor)
 {
 	// The user has sent a command to the sensor.
@@ -699,7 +1775,7 @@ void CommandSensor(void *sensor)
 	// sensor->data Fields 0-2.
 	// A string is saved in sensor->custom. Don't forget
 	// to cast it to a (char*)
-	char msg[32];
+	char msg[256];
 	float x,y,z;
 
 	int id = ((VRUTSensorObj *)sensor)->user[0];
@@ -707,21 +1783,35 @@ void CommandSensor(void *sensor)
 	cout << "Calling command " << (int) ((VRUTSensorObj *)sensor)->command
 		<< " for sensor " << id << "\n" << flush;
 
-	strcpy(msg,(char *)((VRUTSensorObj *)sensor)->custom);
+	strncpy(msg,(char *)((VRUTSensorObj *)sensor)->custom, sizeof(msg)-1);
+	msg[sizeof(msg)-1] = '\0';
 	x = ((VRUTSensorObj *)sensor)->data[0];
 	y = ((VRUTSensorObj *)sensor)->data[1];
 	z = ((VRUTSensorObj *)sensor)->data[2];
 
 	int marker;
+	if(ServerStarting() && !StartupCommandAllowed((int) ((VRUTSensorObj *)sensor)->command)) {
+		cout << "Warning: the PhaseSpace server is starting (poll with command 29) ... ignoring command "
+			<< (int) ((VRUTSensorObj *)sensor)->command << "\n" << flush;
+		return;
+	}
 	switch( (int) ((VRUTSensorObj *)sensor)->command) {
 case 1:
 	cout << "Sensor data is:\n" << *(ALL_SENSORS[id]) << "\n" << flush;
 	break;
 case 2:
-	SCALE_X = x; SCALE_Y = y; SCALE_Z = z;
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		SCALE_X = x; SCALE_Y = y; SCALE_Z = z;
+	}
+	++CONFIG_GENERATION;
 	break;
 case 3:
-	OFFSET_X = x; OFFSET_Y = y; OFFSET_Z = z;
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		OFFSET_X = x; OFFSET_Y = y; OFFSET_Z = z;
+	}
+	++CONFIG_GENERATION;
 	break;
 case 4:
 	REQUEST_RESET_ORIGIN = true;
@@ -754,6 +1844,7 @@ case 6:
 	}
 	if(ALL_SENSORS[id]->markers.size() >= 3) {
 		ALL_SENSORS[id]->isRigid = true;
+		ALL_SENSORS[id]->solve = SENSOR_SOLVE_NONE;
 		ALL_SENSORS[id]->needsInitialization = true;
 		UpdateRigidCount();
 	} else {
@@ -769,14 +1860,32 @@ case 7:
 		return;
 	}
 	ALL_SENSORS[id]->isRigid = false;
+	ALL_SENSORS[id]->solve = SENSOR_SOLVE_NONE;
 	ALL_SENSORS[id]->needsInitialization = true;
+	UpdateRigidCount();
 	break;
 case 8:
-	//start the server (it handles checking)
+	//start the server on the startup thread and wait for it to finish
+	//x = 2 returns at once instead: poll with command 29, until it says streaming only
+	//commands 8, 29, 110, 114 and 115 are taken
+	//a start while one is running waits for it (x = 2 does nothing), once started does nothing
 	if(OWL_SERVER.length() < 1) {
 		cout << "Error: server not set ... ignoring start.\nSet the server and try again.\n" << flush;
 	} else {
-		StartServer();
+		if(START_STATE == START_IDLE || START_STATE == START_FAILED) {
+			if(START_THREAD && START_THREAD->joinable()) {
+				START_THREAD->join();
+			}
+			if(!SERVER_STARTED) {
+				SizeHistories();
+			}
+			START_STATE = START_CONNECTING;
+			START_THREAD.reset(new boost::thread(StartServer));
+		}
+		if(x != 2.0f && START_THREAD->joinable()) {
+			START_THREAD->join();
+		}
+		ShowSetupStatus();
 	}
 	break;
 case 9:
@@ -843,8 +1952,327 @@ case 11:
 		}
 	}
 	break;
+case 12:
+	//set how the read thread waits between polls
+	//x = 0 spin, 1 spin then yield, 2 sleep until just before the next frame
+	//y = wake this many milliseconds before the next frame (mode 2, 0 keeps the current value)
+	marker = int(x+0.5f);
+	if(marker < 0 || marker >= READ_WAIT_MODE_COUNT) {
+		cout << "Error: unknown read wait mode " << marker << " ... ignoring\n" << flush;
+	} else {
+		READ_WAIT_MODE = marker;
+		if(y > 0.0f) {
+			READ_WAIT_MARGIN = 0.001*y;
+		}
+		REQUEST_READ_WAIT_CHANGE = true;
+	}
+	break;
+case 13:
+	//print the read thread cpu use and frame pickup latency for each wait mode
+	if(READ_STARTED) {
+		REQUEST_READ_WAIT_REPORT = true;
+	} else {
+		cout << "Read thread not started ... no wait statistics\n" << flush;
+	}
+	break;
+case 14:
+	//clock check: source, read cost and resolution
+	//reply data[7] source (EClockSource), data[8] read cost (ns), data[9] resolution (ns), data[10] ticks per us
+	{
+		double cost, resolution;
+		simClock.measure(1000000, cost, resolution);
+		cout << "Clock: " << simClock.sourceName() << " at " << simClock.frequency() << " Hz, read cost "
+			<< 1.0e9*cost << " ns, resolution " << 1.0e9*resolution << " ns\n" << flush;
+		float reply[4] = {float(simClock.source()), float(1.0e9*cost), float(1.0e9*resolution), float(1.0e-6*simClock.frequency())};
+		SetReply((VRUTSensorObj *)sensor, reply, 4);
+	}
+	break;
+case 20:
+	//give this sensor its own OWL -> Vizard calibration instead of the global scale/offset
+	//message = 12 numbers (3x4 row major) or 16 (4x4 with a last row of 0 0 0 1)
+	//p_viz = A*p_owl + b; the default is A = diag(-SCALE_X, SCALE_Y, SCALE_Z) (see CPoseTransform.h)
+	{
+		float m[16];
+		int count = 0;
+		istringstream in(msg);
+		while(count < 16 && in >> m[count]) {
+			++count;
+		}
+		if(count == 16 && (m[12] != 0.0f || m[13] != 0.0f || m[14] != 0.0f || m[15] != 1.0f)) {
+			cout << "Error: calibration must be affine (last row 0 0 0 1) ... ignoring\n" << flush;
+		} else if(count != 12 && count != 16) {
+			cout << "Error: calibration needs 12 or 16 numbers, got " << count << " ... ignoring\n" << flush;
+		} else {
+			cPoseTransformBatch check;
+			check.resize(1);
+			if(!check.setCalibration(0, m)) {
+				cout << "Warning: calibration has no proper rotation once x is mirrored, orientations only get the mirror\n" << flush;
+			}
+			{
+				boost::mutex::scoped_lock l(config_mutex);
+				memcpy(ALL_SENSORS[id]->calibration, m, sizeof(ALL_SENSORS[id]->calibration));
+				ALL_SENSORS[id]->hasCalibration = true;
+			}
+			++CONFIG_GENERATION;
+		}
+	}
+	break;
+case 21:
+	//back to the global scale/offset
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		ALL_SENSORS[id]->hasCalibration = false;
+	}
+	++CONFIG_GENERATION;
+	break;
 
 	//high speed recording stuff
+case 22:
+	//set as a rigid body solved here from its point markers (see CRigidSolver.h), for
+	//slave connections where OWL rigids cannot be made; data[0..6] as for an OWL rigid.
+	//The template is captured when streaming starts (command 8) unless set by command 23
+	if(ALL_SENSORS[id]->isStarted) {
+		cout << "Error: cannot restart sensor ... skipping\n" << flush;
+		return;
+	}
+	if(ALL_SENSORS[id]->markers.size() >= 3) {
+		ALL_SENSORS[id]->isRigid = false;
+		ALL_SENSORS[id]->solve = SENSOR_SOLVE_RIGID;
+		ALL_SENSORS[id]->needsInitialization = true;
+		UpdateRigidCount();
+	} else {
+		cout << "Warning: must add at least three markers to the object to create a rigid body ... skipping\n" << flush;
+	}
+	break;
+case 23:
+	//template for command 22: the message is x y z of each marker in the order added,
+	//OWL units in the body frame (the first marker usually at 0 0 0)
+	if(ALL_SENSORS[id]->isStarted) {
+		cout << "Error: cannot change the template of a started sensor ... skipping\n" << flush;
+		return;
+	}
+	{
+		istringstream in(msg);
+		vector<float*> definition;
+		float p[3];
+		while(in >> p[0] >> p[1] >> p[2]) {
+			float* point = new float[3];
+			memcpy(point, p, sizeof(p));
+			definition.push_back(point);
+		}
+		if(definition.size() != ALL_SENSORS[id]->markers.size()) {
+			cout << "Error: template has " << definition.size() << " points for " << ALL_SENSORS[id]->markers.size()
+				<< " markers ... ignoring\n" << flush;
+			for(int i = 0; i < definition.size(); ++i) {
+				delete[] definition[i];
+			}
+			break;
+		}
+		for(int i = 0; i < ALL_SENSORS[id]->rigidBodyDefinition.size(); ++i) {
+			delete[] ALL_SENSORS[id]->rigidBodyDefinition[i];
+		}
+		ALL_SENSORS[id]->rigidBodyDefinition = definition;
+	}
+	break;
+case 24:
+	//set as a segment between two groups of its markers (see CSegmentSolver.h):
+	//x = markers in the first group (in the order added, the rest are the second group),
+	//message = reference axis "x y z" in Vizard coordinates that is turned onto the
+	//direction from the first group to the second (default 1 0 0); data[0..2] is the midpoint
+	if(ALL_SENSORS[id]->isStarted) {
+		cout << "Error: cannot restart sensor ... skipping\n" << flush;
+		return;
+	}
+	marker = int(x+0.5f);
+	if(marker < 1 || marker >= ALL_SENSORS[id]->markers.size()) {
+		cout << "Error: a segment needs markers in both groups (" << marker << " of "
+			<< ALL_SENSORS[id]->markers.size() << " in the first) ... skipping\n" << flush;
+		break;
+	}
+	if(strlen(msg) > 0) {
+		float axis[3] = {0.0f, 0.0f, 0.0f};
+		istringstream in(msg);
+		in >> axis[0] >> axis[1] >> axis[2];
+		if(!ALL_SENSORS[id]->segmentSolver.setAxis(axis)) {
+			cout << "Error: bad segment axis " << msg << " ... skipping\n" << flush;
+			break;
+		}
+	}
+	ALL_SENSORS[id]->segmentSolver.setSplit(marker);
+	ALL_SENSORS[id]->isRigid = false;
+	ALL_SENSORS[id]->solve = SENSOR_SOLVE_SEGMENT;
+	ALL_SENSORS[id]->needsInitialization = true;
+	UpdateRigidCount();
+	break;
+case 25:
+	//gap filling for a sensor built from point markers (not an OWL rigid, OWL fills those):
+	//x = 1 on, 0 off; y = longest a lost marker is carried on at its last velocity, ms
+	//(default 100). Lost markers are placed from the rigid definition (or the last frame
+	//with every marker seen) when at least three are seen
+	if(ALL_SENSORS[id]->isRigid) {
+		cout << "Error: OWL rigids are filled by OWL ... ignoring\n" << flush;
+		break;
+	}
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		ALL_SENSORS[id]->gapFill = x > 0.5f;
+		ALL_SENSORS[id]->gapFillLimit = y > 0.0f ? 0.001f*y : 0.1f;
+	}
+	++CONFIG_GENERATION;
+	break;
+case 26:
+	//rigid body definition cache file (message, empty for no cache), before the server starts
+	if(SERVER_STARTED) {
+		cout << "Error: set the rigid body cache before starting the server ... ignoring\n" << flush;
+		break;
+	}
+	RIGID_CACHE_FILE = msg;
+	break;
+case 27:
+	//forget this sensor's cached rigid body definition (set the server first, command 9),
+	//it is captured again the next time the server starts
+	if(!RIGID_CACHE_FILE.empty()) {
+		RIGID_CACHE.load(RIGID_CACHE_FILE);
+		if(RIGID_CACHE.erase(OWL_SERVER, ALL_SENSORS[id]->markers) && !RIGID_CACHE.save(RIGID_CACHE_FILE)) {
+			cout << "Warning: could not write the rigid body cache " << RIGID_CACHE_FILE << "\n" << flush;
+		}
+	}
+	break;
+case 28:
+	//forget every cached rigid body definition
+	if(!RIGID_CACHE_FILE.empty()) {
+		RIGID_CACHE.clear();
+		if(!RIGID_CACHE.save(RIGID_CACHE_FILE)) {
+			cout << "Warning: could not write the rigid body cache " << RIGID_CACHE_FILE << "\n" << flush;
+		}
+	}
+	break;
+case 29:
+	//server start progress: data[7] = EStartState (0 idle, 1 connecting, 2 calibrating,
+	//3 configuring, 4 streaming, 5 failed), data[8] = sensors set up, data[9] = sensors to
+	//set up, data[10] = frames sampled for rigid definitions, data[11] = this sensor's
+	//ESetupState (0 none, 1 pending, 2 calibrating, 3 configuring, 4 started, 5 failed),
+	//data[12] = why it failed (0 none, 1 no markers, 2 markers not seen, 3 OWL tracker error)
+	//once streaming, a sensor that failed also gets status false
+	{
+		ShowSetupStatus();
+		float reply[6];
+		reply[0] = float(START_STATE.load());
+		reply[1] = float(START_SENSORS_DONE.load());
+		reply[2] = float(START_SENSORS_TOTAL.load());
+		reply[3] = float(START_FRAMES.load());
+		reply[4] = float(ALL_SENSORS[id]->setupState.load());
+		reply[5] = float(ALL_SENSORS[id]->setupError.load());
+		SetReply((VRUTSensorObj *)sensor, reply, 6);
+	}
+	break;
+case 30:
+	//copy every started sensor's latest pose to its data fields now
+	UpdateAllSensors();
+	break;
+case 31:
+	//full rate samples of this sensor (read them with the ReadSensorSamples export)
+	//reply data[7] = samples since the last read, data[8] = samples lost (overwritten
+	//before they were read), data[9] = samples kept; x = 1 skips what is waiting
+	{
+		if(x == 1.0f) {
+			ALL_SENSORS[id]->history.skip();
+		}
+		float reply[3];
+		reply[0] = float(ALL_SENSORS[id]->history.waiting());
+		reply[1] = float(ALL_SENSORS[id]->history.lost());
+		reply[2] = float(ALL_SENSORS[id]->history.capacity());
+		SetReply((VRUTSensorObj *)sensor, reply, 3);
+	}
+	break;
+case 32:
+	//seconds of full rate samples kept for this sensor (commands 31 and 33), before the
+	//server starts, sized with the frequency (command 10) at the start
+	if(SERVER_STARTED) {
+		cout << "Error: set the history length before starting the server ... ignoring\n" << flush;
+	} else if(x <= 0.0f || x*LOCAL_OWL_FREQUENCY > 16777216.0f) {
+		cout << "Error: bad history length " << x << " s ... ignoring\n" << flush;
+	} else {
+		ALL_SENSORS[id]->historySeconds = x;
+	}
+	break;
+case 33:
+	//pose at a past time: the message (full double precision, as in command 114) or x, on
+	//the clock of recorded sample times; y = 1 for the nearest sample instead of interpolating
+	//reply data[7] = 1 found (0 if the time is not in the history), data[8..14] pose,
+	//data[15] cond, data[16] ttl, data[17] flags (ERecordFlags)
+	{
+		double t = strlen(msg) > 0 ? atof(msg) : double(x);
+		SPoseSample sample;
+		float reply[11] = {0.0f};
+		if(ALL_SENSORS[id]->history.sampleAt(t, y != 1.0f, sample)) {
+			reply[0] = 1.0f;
+			memcpy(reply + 1, sample.pose, sizeof(sample.pose));
+			reply[8] = sample.cond;
+			reply[9] = float(sample.ttl);
+			reply[10] = float(sample.flags);
+		}
+		SetReply((VRUTSensorObj *)sensor, reply, 11);
+	}
+	break;
+case 34:
+	//publish every frame's poses to shared memory named by the message for other processes
+	//(CPoseBusClient.h), empty for none, before the server starts
+	if(SERVER_STARTED) {
+		cout << "Error: set the pose bus before starting the server ... ignoring\n" << flush;
+		break;
+	}
+	POSE_BUS_NAME = msg;
+	break;
+case 35:
+	//record (and stream) only around TTL edges: x = seconds before the edge, y = seconds
+	//after it, z = keep 1 in z samples outside the windows (0 none); the message is
+	//"lines edge": the TTL lines watched as bits (ttl_0 = 1, default 1) and 1 rising
+	//(default), 2 falling or 3 both. x and y 0 records everything again
+	{
+		STtlWindowSettings settings;
+		settings.pre = x;
+		settings.post = y;
+		settings.decimation = int(z + 0.5f);
+		settings.lines = 1;
+		settings.edge = TTL_EDGE_RISING;
+		sscanf(msg, "%d %d", &settings.lines, &settings.edge);
+		if(x < 0.0f || y < 0.0f || z < 0.0f || settings.lines <= 0 || settings.lines > 15
+			|| settings.edge < TTL_EDGE_RISING || settings.edge > TTL_EDGE_BOTH) {
+			cout << "Error: bad TTL window " << x << " " << y << " " << z << " \"" << msg << "\" ... ignoring\n" << flush;
+			break;
+		}
+		boost::mutex::scoped_lock l(config_mutex);
+		ALL_SENSORS[id]->ttlWindow = settings;
+	}
+	++CONFIG_GENERATION;
+	break;
+case 36:
+	//TTL windows closed since recording started (command 100): reply data[7] = count;
+	//with a message they are also written to that file, one line per window:
+	//trigger_time ttl_before ttl_after edges first_sample_time last_sample_time samples
+	{
+		vector<STtlWindow> windows;
+		{
+			boost::mutex::scoped_lock l(block_mutex);
+			windows = ALL_SENSORS[id]->windows;
+		}
+		if(strlen(msg) > 0) {
+			ofstream out(msg);
+			out.precision(12);
+			for(int i = 0; i < windows.size(); ++i) {
+				out << windows[i].trigger << " " << windows[i].ttlBefore << " " << windows[i].ttlAfter << " "
+					<< windows[i].triggers << " " << windows[i].start << " " << windows[i].end << " "
+					<< windows[i].samples << "\n";
+			}
+			if(!out.good()) {
+				cout << "Error: could not write the TTL windows to " << msg << "\n" << flush;
+			}
+		}
+		float reply[1] = {float(windows.size())};
+		SetReply((VRUTSensorObj *)sensor, reply, 1);
+	}
+	break;
 case 100:
 	//request recording of this phasespace marker and clear anything that was there
 	{
@@ -852,6 +2280,7 @@ case 100:
 		ALL_SENSORS[id]->requestRecording = false; //just in case threading changes
 		ALL_SENSORS[id]->record.clear();
 		ALL_SENSORS[id]->record.reserve(PREALLOCATION_SIZE);
+		ALL_SENSORS[id]->windows.clear();
 		ALL_SENSORS[id]->requestRecording = true;
 	}
 	break;
@@ -863,8 +2292,10 @@ case 101:
 	}
 	break;
 case 102:
-	//dump the phasespace data, uses the file specified by the message (or test_ps_dump.txt)
-	DoDumpFile(id, msg);
+	//dump the phasespace data, uses the file specified by the message (or test_ps_dump.psr)
+	//binary by default (see CRecording.h), x = 1 writes the old text format
+	//returns right away, the file is written in the background (poll with 109)
+	DoDumpFile(id, msg, int(x+0.5f) == 1);
 	break;
 case 103:
 	//clear the current recording
@@ -872,14 +2303,261 @@ case 103:
 		boost::mutex::scoped_lock l(block_mutex);
 		ALL_SENSORS[id]->record.clear();
 		ALL_SENSORS[id]->record.reserve(PREALLOCATION_SIZE);
+		ALL_SENSORS[id]->windows.clear();
 	}
 	break;
 case 104:
 	//synchronize the current time with the Vizard tick
+	//(a single offset, drops any samples from command 114)
 	{
-		boost::mutex::scoped_lock l(block_mutex);
-		timeOffset = x-simClock.getCPUTimeSeconds();
-		cout << "Setting PhaseSpace time offset to " << x << " - " << simClock.getCPUTimeSeconds() << " = " << timeOffset << "\n" << flush;
+		boost::mutex::scoped_lock l(config_mutex);
+		double now = simClock.getCPUTimeSeconds();
+		CLOCK_SYNC.reset(x-now);
+		++CONFIG_GENERATION;
+		cout << "Setting PhaseSpace time offset to " << x << " - " << now << " = " << x-now << "\n" << flush;
+	}
+	break;
+case 105:
+	//stream this sensor straight to the file given by the message, for sessions
+	//too long to keep in memory (bounded memory, see CStreamRecorder.h)
+	//binary by default, x = 1 writes the old text format
+	StartStreamRecording(id, msg, int(x+0.5f) == 1);
+	break;
+case 106:
+	//stop streaming, the writer thread finishes the file in the background
+	{
+		boost::mutex::scoped_lock l(stream_mutex);
+		cStreamRecorder* stream = ALL_SENSORS[id]->stream.load();
+		if(stream != NULL) {
+			stream->stop(READ_EPOCH);
+		}
+	}
+	break;
+case 107:
+	//print the streaming status
+	{
+		boost::mutex::scoped_lock l(stream_mutex);
+		cStreamRecorder* stream = ALL_SENSORS[id]->stream.load();
+		if(stream == NULL) {
+			cout << "Sensor " << id << " has not streamed\n" << flush;
+		} else {
+			static const char* states[] = {"idle", "running", "stopping"};
+			cout << "Sensor " << id << " streaming " << states[stream->state()] << ": "
+				<< stream->written() << " written, " << stream->waiting() << " waiting (of "
+				<< stream->capacity() << "), " << stream->overflow() << " dropped\n" << flush;
+		}
+	}
+	break;
+case 109:
+	//status of the last dump queued: data[7] = state (0 none, 1 queued, 2 writing, 3 done,
+	//4 failed), data[8] = samples written, data[9] = samples in the dump,
+	//data[10] = dumps of this sensor still queued or being written (0 once all are on disk)
+	{
+		float reply[4];
+		{
+			boost::mutex::scoped_lock l(dump_mutex);
+			reply[0] = float(ALL_SENSORS[id]->dumpState);
+			reply[1] = float(ALL_SENSORS[id]->dumpWritten);
+			reply[2] = float(ALL_SENSORS[id]->dumpTotal);
+			reply[3] = float(ALL_SENSORS[id]->dumpsPending);
+		}
+		SetReply((VRUTSensorObj *)sensor, reply, 4);
+	}
+	break;
+case 110:
+	//latency statistics in milliseconds:
+	//data[7..9]   age of the pose when read by UpdateSensor: p50, p99, max
+	//data[10..12] interval between good samples: p50, p99, max
+	//data[13..15] frame arrival to publish (all sensors): p50, p99, max
+	//data[16..17] number of reads and intervals behind the numbers
+	{
+		float reply[11];
+		const cLatencyHistogram* h[3] = {&ALL_SENSORS[id]->latency, &ALL_SENSORS[id]->interval, &PUBLISH_LATENCY};
+		for(int k = 0; k < 3; ++k) {
+			reply[3*k + 0] = float(1000.0*h[k]->percentile(0.5));
+			reply[3*k + 1] = float(1000.0*h[k]->percentile(0.99));
+			reply[3*k + 2] = float(1000.0*h[k]->maximum());
+		}
+		reply[9] = float(ALL_SENSORS[id]->latency.count());
+		reply[10] = float(ALL_SENSORS[id]->interval.count());
+		SetReply((VRUTSensorObj *)sensor, reply, 11);
+	}
+	break;
+case 111:
+	//reset this sensor's latency statistics (and the shared publish statistics)
+	ALL_SENSORS[id]->latency.requestReset();
+	ALL_SENSORS[id]->interval.requestReset();
+	PUBLISH_LATENCY.requestReset();
+	break;
+case 112:
+	//write every histogram to the file given by the message
+	//(blocks of "lower_ns upper_ns count" lines, one block per histogram)
+	{
+		ofstream out(msg);
+		if(!out.good()) {
+			cout << "Error: could not open " << msg << " for the latency histograms ... ignoring\n" << flush;
+			break;
+		}
+		out << "# publish (frame arrival to publish, all sensors)\n";
+		PUBLISH_LATENCY.write(out);
+		for(int i = 0; i < ALL_SENSORS.size(); ++i) {
+			out << "# sensor " << i << " latency (arrival to UpdateSensor)\n";
+			ALL_SENSORS[i]->latency.write(out);
+			out << "# sensor " << i << " interval (between good samples)\n";
+			ALL_SENSORS[i]->interval.write(out);
+		}
+	}
+	break;
+case 114:
+	//add a clock sync sample: the Vizard tick read just before this call, from the
+	//message if there is one (full double precision, use it for long sessions) or x
+	//call repeatedly (e.g. once a second), offset and drift are fitted over the last
+	//cClockSync::SYNC_WINDOW samples and applied to every recorded time from then on
+	{
+		double tick = strlen(msg) > 0 ? atof(msg) : double(x);
+		boost::mutex::scoped_lock l(config_mutex);
+		CLOCK_SYNC.add(simClock.getCPUTimeSeconds(), tick);
+		++CONFIG_GENERATION;
+	}
+	break;
+case 115:
+	//clock sync quality
+	//reply data[7] offset now (s), data[8] drift (ppm), data[9] rms residual (ms),
+	//data[10] largest residual (ms), data[11] samples in the window, data[12] samples kept
+	{
+		boost::mutex::scoped_lock l(config_mutex);
+		double now = simClock.getCPUTimeSeconds();
+		float reply[6] = {float(CLOCK_SYNC.offsetAt(now)), float(1.0e6*(CLOCK_SYNC.rate() - 1.0)),
+			float(1000.0*CLOCK_SYNC.rms()), float(1000.0*CLOCK_SYNC.maxResidual()),
+			float(CLOCK_SYNC.count()), float(CLOCK_SYNC.inliers())};
+		SetReply((VRUTSensorObj *)sensor, reply, 6);
+	}
+	break;
+case 116:
+	//pose prediction for this sensor: x = mode (0 off, 1 constant velocity, 2 constant
+	//acceleration; orientation uses the angular velocity in both), y = horizon in ms
+	//(e.g. the render latency: UpdateSensor then gives the pose y ms after it runs)
+	marker = int(x+0.5f);
+	if(marker < 0 || marker >= PREDICT_MODE_COUNT) {
+		cout << "Error: unknown prediction mode " << marker << " ... ignoring\n" << flush;
+	} else {
+		ALL_SENSORS[id]->predictMode = marker;
+		ALL_SENSORS[id]->predictHorizon = 0.001f*y;
+	}
+	break;
+case 117:
+	//pose predicted for a Vizard tick (message, or x), with this sensor's mode
+	//(constant velocity if prediction is off), reply in data[7..13] like data[0..6]
+	{
+		double tick = strlen(msg) > 0 ? atof(msg) : double(x);
+		double target;
+		{
+			boost::mutex::scoped_lock l(config_mutex);
+			const SClockMapping& c = CLOCK_SYNC.mapping();
+			target = c.reference + (tick - c.intercept)/c.rate;
+		}
+		SPoseSnapshot snapshot;
+		ALL_SENSORS[id]->published.read(snapshot);
+		int mode = ALL_SENSORS[id]->predictMode != PREDICT_HOLD ? ALL_SENSORS[id]->predictMode : PREDICT_VELOCITY;
+		float predicted[7];
+		cPosePredictor::extrapolate(snapshot.pose, snapshot.rates, mode, target - snapshot.arrival, predicted);
+		SetReply((VRUTSensorObj *)sensor, predicted, 7);
+	}
+	break;
+case 118:
+	//prediction error against a binary recording (message) for a range of horizons,
+	//printed as a table; reply data[7..15] is the rms position error at 10, 20 and 50 ms
+	//for hold, velocity and acceleration in turn
+	{
+		cRecordingReader reader;
+		if(!reader.open(msg)) {
+			cout << "Error: could not open recording " << msg << " ... no evaluation\n" << flush;
+			break;
+		}
+		SRecordSpan samples = reader.samples();
+		bool rigid = reader.header().isRigid != 0;
+		vector<double> times(samples.size());
+		vector<float> poses(7*samples.size());
+		//recordings keep arrival times, put them back on the frame grid for the predictor
+		double period = reader.header().frequency > 0.0f ? 1.0/reader.header().frequency : 0.0;
+		double lastFrame = -1.0;
+		for(int i = 0; i < samples.size(); ++i) {
+			const SRecordSample& r = samples[i];
+			float pose[7] = {r.x, r.y, r.z, r.qx, r.qy, r.qz, r.qw};
+			//version 1 files stored 1 0 0 0 for point markers
+			if(!rigid) {
+				pose[3] = 0.0f; pose[4] = 0.0f; pose[5] = 0.0f; pose[6] = 1.0f;
+			}
+			times[i] = r.time;
+			if(period > 0.0) {
+				double frame = floor((r.time - samples[0].time)/period + 0.5);
+				if(frame <= lastFrame) {
+					frame = lastFrame + 1.0;
+				}
+				lastFrame = frame;
+				times[i] = samples[0].time + frame*period;
+			}
+			memcpy(&poses[7*i], pose, sizeof(pose));
+		}
+		const double horizonMs[] = {5.0, 10.0, 20.0, 30.0, 50.0, 75.0, 100.0};
+		vector<double> horizons;
+		for(int i = 0; i < sizeof(horizonMs)/sizeof(horizonMs[0]); ++i) {
+			horizons.push_back(0.001*horizonMs[i]);
+		}
+		vector<cPosePredictor::SEvaluation> result = cPosePredictor::evaluate(times, poses, horizons);
+		cout << "Prediction error for " << msg << " (" << samples.size() << " samples), rms position / angle (deg)\n"
+			<< "   horizon ms    hold    velocity    acceleration\n";
+		float reply[9];
+		int replied = 0;
+		for(int i = 0; i < result.size(); ++i) {
+			cout << "   " << 1000.0*result[i].horizon;
+			for(int mode = 0; mode < PREDICT_MODE_COUNT; ++mode) {
+				cout << "    " << result[i].position[mode] << " / " << result[i].angle[mode];
+			}
+			cout << "   (" << result[i].count << ")\n";
+			if(horizonMs[i] == 10.0 || horizonMs[i] == 20.0 || horizonMs[i] == 50.0) {
+				for(int mode = 0; mode < PREDICT_MODE_COUNT; ++mode) {
+					reply[replied++] = float(result[i].position[mode]);
+				}
+			}
+		}
+		cout << flush;
+		SetReply((VRUTSensorObj *)sensor, reply, replied);
+	}
+	break;
+case 119:
+	//smoothing of this sensor's pose in the read thread (recordings stay raw):
+	//x = 0 off, 1 exponential (y = time constant ms), 2 One Euro (y = minimum cutoff Hz,
+	//z = beta, message = derivative cutoff Hz, default 1), 3 Savitzky-Golay (y = window,
+	//odd 3 to 15, z = lag in frames: 0 none, (y-1)/2 centred)
+	{
+		SPoseFilterSettings settings;
+		settings.type = int(x+0.5f);
+		settings.a = settings.type == POSE_FILTER_EXPONENTIAL ? 0.001f*y : y;
+		settings.b = z;
+		settings.c = strlen(msg) > 0 ? float(atof(msg)) : 1.0f;
+		const char* problem = cPoseFilterBatch::invalid(settings);
+		if(problem != NULL) {
+			cout << "Error: filter " << settings.type << " (" << y << ", " << z << "): " << problem << " ... ignoring\n" << flush;
+			break;
+		}
+		boost::mutex::scoped_lock l(config_mutex);
+		ALL_SENSORS[id]->filter = settings;
+		++CONFIG_GENERATION;
+	}
+	break;
+case 113:
+	//performance report (one JSON line, see WritePerfReport) appended to the file
+	//given by the message, or printed if there is no message
+	if(strlen(msg) == 0) {
+		WritePerfReport(cout);
+	} else {
+		ofstream out(msg, ios::out | ios::app);
+		if(!out.good()) {
+			cout << "Error: could not open " << msg << " for the performance report ... ignoring\n" << flush;
+			break;
+		}
+		WritePerfReport(out);
 	}
 	break;
 
@@ -893,39 +2571,62 @@ void CloseSensor(void *sensor)
 	// Go ahead, clean up, and close files and COM ports.
 	//Called only once no matter how many instances were created
 
+	//stop the read thread first, it uses the marker/rigid holders until it returns
+	//(it checks REQUEST_SHUTDOWN every poll, including while waiting for a frame)
+	//a start still going is let finish (a rigid capture gives up on the request), it may
+	//still make the read thread
+	REQUEST_SHUTDOWN = true;
+	if(START_THREAD) {
+		START_THREAD->join();
+	}
+	if(READ_THREAD) {
+		READ_THREAD->join();
+	}
+	POSE_BUS.close();
+
+	//finish any streaming files
+	if(WRITER_THREAD) {
+		REQUEST_WRITER_SHUTDOWN = true;
+		WRITER_THREAD->join();
+	}
+	for(int i = 0; i < STREAM_RECORDERS.size(); ++i) {
+		delete STREAM_RECORDERS[i];
+	}
+	STREAM_RECORDERS.clear();
+
+	//finish any queued dumps
+	if(DUMP_THREAD) {
+		{
+			boost::mutex::scoped_lock l(dump_mutex);
+			REQUEST_DUMP_SHUTDOWN = true;
+		}
+		dump_condition.notify_one();
+		DUMP_THREAD->join();
+	}
+
 	if(SERVER_STARTED) {
 		//clean up the marker/rigid holders
 		delete [] GLOBAL_MARKERS;
 		delete [] GLOBAL_RIGIDS;
 
 		//stop the server
-		owlDone();
+		OWL_BACKEND->done();
 	}
 
-	//wait for the read thread to unblock
-	if(READ_THREAD) {
-		REQUEST_SHUTDOWN = true;
-		READ_THREAD->join();
-	}
 	//nothing but local clean up if this is a slave connection
 	if( (LOCAL_FLAGS & OWL_SLAVE) == OWL_SLAVE ) {
-		//clean up the marker/rigid holders
-		delete [] GLOBAL_MARKERS;
-		delete [] GLOBAL_RIGIDS;
 		return;
 	}
 
 	//stop the trackers
 	for(int i = 0; i < ALL_SENSORS.size(); ++i) {
 		if(ALL_SENSORS[i]->isRigid && ALL_SENSORS[i]->isStarted) {
-			owlTracker(ALL_SENSORS[i]->trackerID, OWL_DISABLE);
-			owlTracker(ALL_SENSORS[i]->trackerID, OWL_DESTROY);
-			//delete the rigids coords if they've been created.
-			if(! (ALL_SENSORS[i]->needsInitialization) ) {
-				for(int j = 0; j < ALL_SENSORS[i]->markers.size(); ++j) {
-					delete[] ALL_SENSORS[i]->rigidBodyDefinition[j];
-				}
-			}
+			OWL_BACKEND->tracker(ALL_SENSORS[i]->trackerID, OWL_DISABLE);
+			OWL_BACKEND->tracker(ALL_SENSORS[i]->trackerID, OWL_DESTROY);
+		}
+		//delete the rigids coords if they've been created (OWL rigids and templates).
+		for(int j = 0; j < ALL_SENSORS[i]->rigidBodyDefinition.size(); ++j) {
+			delete[] ALL_SENSORS[i]->rigidBodyDefinition[j];
 		}
 		delete ALL_SENSORS[i];
 	}
@@ -0,0 +1,154 @@
+//Drives the plugin the way Vizard does, for the harnesses in this directory: makes the
+//sensor instances, sends commands with their three numbers and message, and reads the
+//reply fields (data[7..], see SetReply in main.cpp). Link with main.cpp.
+//
+//   cPluginDriver plugin;
+//   int id = plugin.add();
+//   plugin.command(id, 5, 0);                   //marker 0
+//   plugin.command(id, 7);                      //a point marker
+//   if(plugin.start("sim:hz=960")) { ... plugin.update(id) ... plugin.data(id)[0] ... }
+//   plugin.close();
+//
+//The plugin's state is global, so a harness starts it once per process.
+
+#ifndef CPluginDriverH
+#define CPluginDriverH
+
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "sensor.h"
+#include "CPoseHistory.h"
+
+extern "C" {
+	void QuerySensor(void *);
+	void InitializeSensor(void *);
+	void UpdateSensor(void *);
+	void CommandSensor(void *);
+	void CloseSensor(void *);
+	void UpdateAllSensors();
+	int ReadSensorSamples(int, SPoseSample*, int);
+}
+
+//the pose fields and the reply after them (POSE_FIELDS and REPLY_SIZE in main.cpp)
+const int PLUGIN_POSE_FIELDS = 7;
+const int PLUGIN_REPLY = 16;
+
+class cPluginDriver {
+public:
+
+	cPluginDriver() : m_closed(false) {
+		m_message[0] = '\0';
+	}
+
+	~cPluginDriver() {
+		close();
+		for(int i = 0; i < m_sensors.size(); ++i) {
+			delete[] m_sensors[i]->data;
+			delete m_sensors[i];
+		}
+	}
+
+	//A new sensor instance, returns its id (user[0]), -1 if the plugin refused it.
+	int add() {
+		VRUTSensorObj* s = new VRUTSensorObj();
+		memset(s, 0, sizeof(VRUTSensorObj));
+		QuerySensor(s);
+		InitializeSensor(s);
+		if(!s->status) {
+			delete s;
+			return -1;
+		}
+		//Vizard allocates the data fields once InitializeSensor has sized them
+		s->data = new float[s->dataSize];
+		memset(s->data, 0, s->dataSize*sizeof(float));
+		m_sensors.push_back(s);
+		return s->user[0];
+	}
+
+	void command(const int& id, const int& command, const float& x = 0.0f, const float& y = 0.0f,
+		const float& z = 0.0f, const char* message = "") {
+		VRUTSensorObj* s = m_sensors[id];
+		strncpy(m_message, message, sizeof(m_message) - 1);
+		m_message[sizeof(m_message) - 1] = '\0';
+		s->command = float(command);
+		s->data[0] = x;
+		s->data[1] = y;
+		s->data[2] = z;
+		s->custom = m_message;
+		CommandSensor(s);
+	}
+
+	//Set the server and start it (command 8 waits for the start), true if the
+	//read thread is going (command 29 says streaming).
+	bool start(const char* server) {
+		command(0, 9, 0.0f, 0.0f, 0.0f, server);
+		command(0, 8);
+		command(0, 29);
+		return reply(0)[0] == 4.0f;
+	}
+
+	void update(const int& id) {
+		UpdateSensor(m_sensors[id]);
+	}
+
+	//pose fields then the reply
+	const float* data(const int& id) const {
+		return m_sensors[id]->data;
+	}
+
+	const float* reply(const int& id) const {
+		return m_sensors[id]->data + PLUGIN_POSE_FIELDS;
+	}
+
+	int size() const {
+		return int(m_sensors.size());
+	}
+
+	//Append the performance report (command 113) to file and return that line.
+	std::string perfReport(const char* file) {
+		command(0, 113, 0.0f, 0.0f, 0.0f, file);
+		std::ifstream in(file);
+		std::string line, last;
+		while(std::getline(in, line)) {
+			last = line;
+		}
+		return last;
+	}
+
+	//a number from a report line, 0 if the key is not there
+	static double reportValue(const std::string& report, const char* key) {
+		std::string quoted = std::string("\"") + key + "\": ";
+		size_t at = report.find(quoted);
+		return at == std::string::npos ? 0.0 : atof(report.c_str() + at + quoted.size());
+	}
+
+	//CloseSensor, once.
+	void close() {
+		if(!m_closed && !m_sensors.empty()) {
+			CloseSensor(m_sensors[0]);
+		}
+		m_closed = true;
+	}
+
+	static void sleep(const double& seconds) {
+		boost::this_thread::sleep(boost::posix_time::microseconds(long(seconds*1.0e6)));
+	}
+
+private:
+	//not copyable (owns the instances)
+	cPluginDriver(const cPluginDriver&);
+	cPluginDriver& operator=(const cPluginDriver&);
+
+	std::vector<VRUTSensorObj*> m_sensors;
+	char m_message[256];
+	bool m_closed;
+};
+
+//---------------------------------------------------------------------------
+#endif
+//---------------------------------------------------------------------------
@@ -0,0 +1,91 @@
+//The precision clock (CPrecisionClock.h): source, read cost, resolution, monotonicity
+//and rate. Built twice by the Makefile, as is and with PRECISION_CLOCK_TSC.
+//
+//   clock_check [seconds for the rate check, default 1]
+//
+//   cost and resolution   measure() over a million back to back reads
+//   monotonic             a thread per core reads for a while, no read may be earlier
+//                         than the one before it on the same thread (moving between
+//                         cores included, which is what matters for the TSC)
+//   rate                  elapsed time against CLOCK_MONOTONIC (QueryPerformanceCounter
+//                         on Windows), in ppm; near 0 unless the TSC is the source
+//
+//Exits 1 if the resolution is coarser than 1 us, a read costs more than 1 us, time went
+//backwards or the rate is off by more than 100 ppm.
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+//the OS clock the TSC is calibrated against
+double OsSeconds() {
+#if defined(_WIN32)
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&frequency);
+	return double(now.QuadPart)/double(frequency.QuadPart);
+#else
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return double(now.tv_sec) + 1.0e-9*double(now.tv_nsec);
+#endif
+}
+
+void Reads(const cPrecisionClock* clock, const long& count, long* backwards) {
+	tClockTicks last = clock->ticks();
+	for(long i = 0; i < count; ++i) {
+		tClockTicks t = clock->ticks();
+		if(t < last) {
+			++*backwards;
+		}
+		last = t;
+		if(i % 4096 == 0) {
+			//give the scheduler chances to move the thread
+			boost::this_thread::yield();
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 1.0;
+	cPrecisionClock clock;
+	cout << "clock_check: " << clock.sourceName() << " at " << clock.frequency() << " Hz\n";
+
+	double cost, resolution;
+	clock.measure(1000000, cost, resolution);
+	cout << "   read cost " << 1.0e9*cost << " ns, resolution " << 1.0e9*resolution << " ns\n";
+
+	int threads = int(boost::thread::hardware_concurrency());
+	if(threads < 2) {
+		threads = 2;
+	}
+	vector<long> backwards(threads, 0);
+	boost::thread_group group;
+	for(int i = 0; i < threads; ++i) {
+		group.create_thread(boost::bind(Reads, &clock, 5000000L, &backwards[i]));
+	}
+	group.join_all();
+	long total = 0;
+	for(int i = 0; i < threads; ++i) {
+		total += backwards[i];
+	}
+	cout << "   " << threads << " threads, " << total << " reads earlier than the one before\n";
+
+	double os0 = OsSeconds();
+	tClockTicks t0 = clock.ticks();
+	boost::this_thread::sleep(boost::posix_time::microseconds(long(seconds*1.0e6)));
+	double os1 = OsSeconds();
+	tClockTicks t1 = clock.ticks();
+	double ppm = 1.0e6*(clock.elapsed(t0, t1)/(os1 - os0) - 1.0);
+	cout << "   rate against the OS clock " << ppm << " ppm over " << os1 - os0 << " s\n";
+
+	bool ok = resolution > 0.0 && resolution <= 1.0e-6 && cost <= 1.0e-6 && total == 0 && fabs(ppm) <= 100.0;
+	cout << (ok ? "clock_check: ok\n" : "clock_check: FAILED\n") << flush;
+	return ok ? 0 : 1;
+}
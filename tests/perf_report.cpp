@@ -0,0 +1,115 @@
+//A run through every hot path the performance report (command 113) covers, ending with
+//one report line appended to a file, so runs of different versions can be compared.
+//
+//   perf_report [report file, default perf_report.jsonl] [seconds, default 3]
+//               [server, default sim:hz=960]
+//
+//8 OWL rigids, 4 rigids solved in the plugin and 32 point markers. Every sensor records
+//and 4 of them also stream to files while a 90 Hz render loop calls UpdateSensor for
+//each; then every recording is dumped. The server can also be a replay: address
+//(COwlReplay.h) to run from a recorded session. The stream and dump files are removed
+//afterwards.
+//Exits 1 if any part of the report stayed empty (no frames, updates, streamed or
+//dumped samples).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "CPluginDriver.h"
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+const int OWL_RIGIDS = 8;
+const int SOLVED_RIGIDS = 4;
+const int POINTS = 32;
+const int STREAMED = 4;
+const double RENDER_PERIOD = 1.0/90.0;
+
+string FileName(const char* kind, const int& id) {
+	ostringstream name;
+	name << "perf_" << kind << "_" << id << ".psr";
+	return name.str();
+}
+
+int main(int argc, char** argv) {
+	const char* file = argc > 1 ? argv[1] : "perf_report.jsonl";
+	double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+	const char* server = argc > 3 ? argv[3] : "sim:hz=960";
+
+	cPluginDriver plugin;
+	int marker = 0;
+	for(int i = 0; i < OWL_RIGIDS + SOLVED_RIGIDS + POINTS; ++i) {
+		int id = plugin.add();
+		int markers = i < OWL_RIGIDS + SOLVED_RIGIDS ? 3 : 1;
+		for(int m = 0; m < markers; ++m) {
+			plugin.command(id, 5, float(marker++));
+		}
+		plugin.command(id, i < OWL_RIGIDS ? 6 : i < OWL_RIGIDS + SOLVED_RIGIDS ? 22 : 7);
+	}
+	if(!plugin.start(server)) {
+		cout << "perf_report: " << server << " did not start\n";
+		plugin.close();
+		return 1;
+	}
+
+	for(int id = 0; id < plugin.size(); ++id) {
+		plugin.command(id, 100);
+	}
+	for(int id = 0; id < STREAMED; ++id) {
+		plugin.command(id, 105, 0.0f, 0.0f, 0.0f, FileName("stream", id).c_str());
+	}
+
+	//render frames
+	cPrecisionClock clock;
+	double start = clock.getCPUTimeSeconds();
+	for(int frame = 1; clock.getCPUTimeSeconds() - start < seconds; ++frame) {
+		for(int id = 0; id < plugin.size(); ++id) {
+			plugin.update(id);
+		}
+		double next = start + frame*RENDER_PERIOD - clock.getCPUTimeSeconds();
+		if(next > 0.0) {
+			plugin.sleep(next);
+		}
+	}
+
+	//stop, dump everything and wait for the files
+	for(int id = 0; id < plugin.size(); ++id) {
+		plugin.command(id, 101);
+		if(id < STREAMED) {
+			plugin.command(id, 106);
+		}
+		plugin.command(id, 102, 0.0f, 0.0f, 0.0f, FileName("dump", id).c_str());
+	}
+	for(int id = 0; id < plugin.size(); ++id) {
+		for(int wait = 0; wait < 1000; ++wait) {
+			plugin.command(id, 109);
+			if(plugin.reply(id)[0] >= 3.0f) {
+				break;
+			}
+			plugin.sleep(0.01);
+		}
+	}
+	string report = plugin.perfReport(file);
+	plugin.close();
+
+	for(int id = 0; id < plugin.size(); ++id) {
+		remove(FileName("dump", id).c_str());
+		if(id < STREAMED) {
+			remove(FileName("stream", id).c_str());
+		}
+	}
+	cout << "perf_report: " << report << "\n" << flush;
+	const char* needed[4] = {"frames", "update_calls", "stream_samples", "dump_samples"};
+	bool ok = true;
+	for(int k = 0; k < 4; ++k) {
+		if(cPluginDriver::reportValue(report, needed[k]) <= 0.0) {
+			cout << "perf_report: no " << needed[k] << "\n";
+			ok = false;
+		}
+	}
+	return ok ? 0 : 1;
+}
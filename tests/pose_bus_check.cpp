@@ -0,0 +1,199 @@
+//The pose bus (CPoseBus.h) read from other processes, as loggers and analysis tools do.
+//
+//   pose_bus_check [seconds, default 3]
+//
+//Three reader processes are forked first, polling the bus every 1, 5 and 100 ms with
+//cPoseBusReader (CPoseBusClient.h), and a fourth that keeps reading the slot the writer
+//fills next, so its reads race the writer. Then the plugin publishes the bus (command
+//34) with 4 OWL rigids and 12 point markers against the synthetic source at 960 Hz with
+//ramp=1 (every coordinate is the frame number, scale 1), until it is closed. Each
+//reader checks every frame it reads whole (end() true):
+//   torn       the entries hold more than one frame number (|x| = |y| = |z| of every
+//              seen sensor, the same for all of them)
+//   order      time and frame number go up from one bus frame to the next
+//   lost       frames overwritten before the reader got to them; the ring holds
+//              POSE_BUS_FRAMES frames (over 250 ms at 960 Hz), so even the 100 ms
+//              reader should lose none
+//The racing reader only checks for torn frames (the others never overlap a write
+//unless they fall a whole ring behind).
+//Exits 1 if a reader saw a torn frame, a frame out of order, lost a frame or read
+//nothing, or the plugin did not start. POSIX only (fork).
+
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "CPluginDriver.h"
+#include "CPoseBusClient.h"
+
+using namespace std;
+
+const int RIGIDS = 4;
+const int POINTS = 12;
+const int READERS = 4;
+const double READER_PERIODS[READERS] = {0.001, 0.005, 0.1, 0.0};   //0 races the writer
+
+string BusName() {
+	ostringstream name;
+	name << "PhaseSpacePoseBusCheck" << getpid();
+	return name.str();
+}
+
+//the frame number a bus frame was made from, -1 if its entries disagree
+float FrameOf(const cPoseBusReader& bus, const SPoseBusSlot* slot) {
+	const SPoseBusEntry* entries = bus.entries(slot);
+	float frame = -1.0f;
+	for(unsigned int i = 0; i < bus.sensorCount(); ++i) {
+		const SPoseBusEntry& e = entries[i];
+		if(e.cond <= 0.1f) {
+			continue;
+		}
+		if(frame < 0.0f) {
+			frame = fabsf(e.pose[0]);
+		}
+		for(int k = 0; k < 3; ++k) {
+			if(fabsf(e.pose[k]) != frame) {
+				return -1.0f;
+			}
+		}
+	}
+	return frame;
+}
+
+//reads the slot the writer fills next over and over until the writer goes: the frame
+//being written (begin() must refuse it until it is published) or the oldest in the ring
+int Racer(const cPoseBusReader& bus) {
+	unsigned long got = 0, torn = 0, overwritten = 0;
+	while(bus.live()) {
+		boost::uint32_t published = bus.published();
+		boost::uint32_t frameRead = published;
+		const SPoseBusSlot* slot = bus.begin(frameRead);
+		if(slot == NULL && published >= bus.ringFrames()) {
+			frameRead = published - bus.ringFrames();
+			slot = bus.begin(frameRead);
+		}
+		if(slot == NULL) {
+			++overwritten;
+			continue;
+		}
+		float frame = FrameOf(bus, slot);
+		if(!bus.end(slot, frameRead)) {
+			++overwritten;
+			continue;
+		}
+		++got;
+		if(frame < 0.0f) {
+			++torn;
+		}
+	}
+	cout << "racing reader: " << got << " frames, " << torn << " torn, " << overwritten
+		<< " refused or overwritten\n" << flush;
+	return got > 0 && torn == 0 ? 0 : 1;
+}
+
+//one reader process, returns its exit code
+int Reader(const string& name, const double& period) {
+	cPoseBusReader bus;
+	for(int tries = 0; !bus.attach(name); ++tries) {
+		if(tries > 1000) {
+			cout << "reader " << 1000.0*period << " ms: no bus\n" << flush;
+			return 1;
+		}
+		cPluginDriver::sleep(0.01);
+	}
+	if(period <= 0.0) {
+		return Racer(bus);
+	}
+	boost::uint32_t next = bus.published();
+	unsigned long got = 0, torn = 0, backwards = 0, lost = 0;
+	double lastTime = -1.0;
+	float lastFrame = -1.0f;
+	bool live = true;
+	while(live) {
+		//read what was published before the writer went, then stop
+		live = bus.live();
+		boost::uint32_t published = bus.published();
+		for(; next != published; ++next) {
+			const SPoseBusSlot* slot = bus.begin(next);
+			if(slot == NULL) {
+				++lost;
+				continue;
+			}
+			double time = slot->time;
+			float frame = FrameOf(bus, slot);
+			if(!bus.end(slot, next)) {
+				++lost;
+				continue;
+			}
+			++got;
+			if(frame < 0.0f) {
+				++torn;
+			} else if(time <= lastTime || frame <= lastFrame) {
+				++backwards;
+			}
+			lastTime = time;
+			lastFrame = frame;
+		}
+		if(live) {
+			cPluginDriver::sleep(period);
+		}
+	}
+	cout << "reader " << 1000.0*period << " ms: " << got << " frames, " << torn << " torn, " << backwards
+		<< " out of order, " << lost << " lost\n" << flush;
+	return got > 0 && torn == 0 && backwards == 0 && lost == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+	string name = BusName();
+
+	//fork before the plugin makes any threads
+	pid_t readers[READERS];
+	for(int r = 0; r < READERS; ++r) {
+		readers[r] = fork();
+		if(readers[r] == 0) {
+			_exit(Reader(name, READER_PERIODS[r]));
+		}
+		if(readers[r] < 0) {
+			cout << "pose_bus_check: fork failed\n" << flush;
+			return 1;
+		}
+	}
+
+	bool ok = true;
+	{
+		cPluginDriver plugin;
+		int marker = 0;
+		for(int i = 0; i < RIGIDS + POINTS; ++i) {
+			int id = plugin.add();
+			int markers = i < RIGIDS ? 3 : 1;
+			for(int m = 0; m < markers; ++m) {
+				plugin.command(id, 5, float(marker++));
+			}
+			plugin.command(id, i < RIGIDS ? 6 : 7);
+		}
+		plugin.command(0, 2, 1.0f, 1.0f, 1.0f);
+		plugin.command(0, 3, 0.0f, 0.0f, 0.0f);
+		plugin.command(0, 34, 0.0f, 0.0f, 0.0f, name.c_str());
+		if(plugin.start("sim:hz=960,ramp=1")) {
+			plugin.sleep(seconds);
+		} else {
+			cout << "pose_bus_check: the synthetic server did not start\n" << flush;
+			ok = false;
+		}
+		plugin.close();
+	}
+
+	for(int r = 0; r < READERS; ++r) {
+		int status = 0;
+		if(waitpid(readers[r], &status, 0) != readers[r] || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			ok = false;
+		}
+	}
+	cout << (ok ? "pose_bus_check: ok\n" : "pose_bus_check: FAILED\n") << flush;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,57 @@
+//Per-frame cost of the read loop (threadMe) for a number of sensors.
+//
+//   read_loop_bench <sensors, 1 to 128> [seconds, default 3]
+//
+//Point marker sensors (one marker each) run against the synthetic source at 960 Hz
+//with the frame-period sleep wait, so the read thread is not competing with itself.
+//After the run the plugin's performance report (command 113) is appended to
+//read_loop_bench.jsonl and the time from a poll returning a frame to its poses being
+//published is printed. The plugin's state is global, so each sensor count is a
+//separate run (see check in the Makefile).
+//read_loop_bench_walk is the same run against the plugin built with
+//READ_LOOP_WALK_ALL_SENSORS, the read loop walking every sensor each frame as it did
+//before the read tables, for the before and after numbers.
+//Exits 1 if the source did not start or no frames were read.
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+#include "CPluginDriver.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+	const char* name = strrchr(argv[0], '/') != NULL ? strrchr(argv[0], '/') + 1 : argv[0];
+	int sensors = argc > 1 ? atoi(argv[1]) : 16;
+	double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+	if(sensors < 1 || sensors > 128) {
+		cout << name << ": 1 to 128 sensors\n";
+		return 1;
+	}
+	cPluginDriver plugin;
+	for(int i = 0; i < sensors; ++i) {
+		int id = plugin.add();
+		plugin.command(id, 5, float(i));
+		plugin.command(id, 7);
+	}
+	plugin.command(0, 12, 2.0f);
+	if(!plugin.start("sim:hz=960")) {
+		cout << name << ": the synthetic server did not start\n";
+		plugin.close();
+		return 1;
+	}
+	//the first frames pay for building the tables and warming the caches
+	plugin.sleep(0.5);
+	plugin.command(0, 111);
+	plugin.sleep(seconds);
+	string report = plugin.perfReport("read_loop_bench.jsonl");
+	plugin.close();
+
+	double frames = cPluginDriver::reportValue(report, "frames");
+	cout << name << ": " << sensors << " sensors, " << cPluginDriver::reportValue(report, "frames_per_s")
+		<< " frames/s, frame us p50 " << cPluginDriver::reportValue(report, "frame_us_p50")
+		<< " p99 " << cPluginDriver::reportValue(report, "frame_us_p99")
+		<< " max " << cPluginDriver::reportValue(report, "frame_us_max") << "\n" << flush;
+	return frames > 0.0 ? 0 : 1;
+}
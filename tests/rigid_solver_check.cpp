@@ -0,0 +1,202 @@
+//The plugin's own rigid solve (CRigidSolver.h, command 22): accuracy and time per body.
+//
+//   rigid_solver_check [solves per template, default 20000]
+//
+//Templates of 3, 4, 6, 8 and 12 markers (random points within 100 mm of the first, as
+//a rigid definition is taken) are moved by random poses and handed to solve() the way
+//the read thread does, with markers dropped at random (each seen 3 times in 4, at
+//least 3 kept):
+//   exact    no noise; the pose must come back to 1e-3 mm and 0.01 degrees
+//   noisy    0.5 mm of gaussian noise on every marker; the mean error must stay under
+//            1 mm and 1 degree, and rms near the noise
+//   line     three markers in a line must be refused
+//Every noisy solve is timed on its own and printed as solve_us_p50/p99/max for each
+//template, the same names as the performance report (command 30).
+//Exits 1 on a wrong pose, an accepted line or a p99 of 10 us or more per body.
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include "CRigidSolver.h"
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+const int TEMPLATES = 5;
+const int TEMPLATE_MARKERS[TEMPLATES] = {3, 4, 6, 8, 12};
+const float NOISE = 0.5f;          //mm
+const double SOLVE_LIMIT = 10.0e-6;
+
+float Random(const float& low, const float& high) {
+	return low + (high - low)*float(rand())/float(RAND_MAX);
+}
+
+float Gaussian() {
+	float u = Random(1.0e-6f, 1.0f), v = Random(0.0f, 1.0f);
+	return sqrtf(-2.0f*logf(u))*cosf(6.2831853f*v);
+}
+
+//a random pose, OWLRigid::pose layout (x, y, z, qw, qx, qy, qz)
+void RandomPose(float pose[7]) {
+	float n = 0.0f;
+	for(int k = 0; k < 3; ++k) {
+		pose[k] = Random(-2000.0f, 2000.0f);
+	}
+	for(int k = 3; k < 7; ++k) {
+		pose[k] = Gaussian();
+		n += pose[k]*pose[k];
+	}
+	n = sqrtf(n);
+	for(int k = 3; k < 7; ++k) {
+		pose[k] /= n;
+	}
+}
+
+//where the body frame point t lands under pose
+void Move(const float pose[7], const float* t, float* out) {
+	float w = pose[3], x = pose[4], y = pose[5], z = pose[6];
+	float r[3][3] = {
+		{1.0f - 2.0f*(y*y + z*z), 2.0f*(x*y - w*z), 2.0f*(x*z + w*y)},
+		{2.0f*(x*y + w*z), 1.0f - 2.0f*(x*x + z*z), 2.0f*(y*z - w*x)},
+		{2.0f*(x*z - w*y), 2.0f*(y*z + w*x), 1.0f - 2.0f*(x*x + y*y)}
+	};
+	for(int k = 0; k < 3; ++k) {
+		out[k] = pose[k] + r[k][0]*t[0] + r[k][1]*t[1] + r[k][2]*t[2];
+	}
+}
+
+//position error in mm and rotation error in degrees
+void PoseError(const float truth[7], const float pose[7], float& position, float& angle) {
+	position = 0.0f;
+	for(int k = 0; k < 3; ++k) {
+		position += (truth[k] - pose[k])*(truth[k] - pose[k]);
+	}
+	position = sqrtf(position);
+	//from the chord between the quaternions (acos of their dot is too coarse near 0)
+	float dot = 0.0f, chord = 0.0f;
+	for(int k = 3; k < 7; ++k) {
+		dot += truth[k]*pose[k];
+	}
+	for(int k = 3; k < 7; ++k) {
+		float d = truth[k] - (dot < 0.0f ? -pose[k] : pose[k]);
+		chord += d*d;
+	}
+	angle = 4.0f*asinf(min(1.0f, 0.5f*sqrtf(chord)))*57.29578f;
+}
+
+//marker weights as cond would give them, 0 for a marker not seen, at least 3 seen
+void RandomVisibility(const int& count, vector<float>& weights) {
+	int seen = 0;
+	for(int i = 0; i < count; ++i) {
+		weights[i] = Random(0.0f, 1.0f) < 0.75f ? Random(0.5f, 1.0f) : 0.0f;
+		seen += weights[i] > 0.0f ? 1 : 0;
+	}
+	for(int i = 0; seen < 3; ++i) {
+		if(weights[i] <= 0.0f) {
+			weights[i] = 1.0f;
+			++seen;
+		}
+	}
+}
+
+struct SErrors {
+	float position, angle, rms;   //sums, then means
+	float worstPosition, worstAngle;
+	int failed;
+};
+
+//solves trials poses of a template, with noise (mm) on every marker; times each solve
+//into times if given
+SErrors Run(const vector<float>& points, const int& trials, const float& noise, vector<double>* times) {
+	int count = int(points.size()/3);
+	cRigidSolver solver;
+	solver.setTemplate(&points[0], count);
+	cPrecisionClock clock;
+	vector<float> observed(3*count), weights(count);
+	SErrors errors = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0};
+	for(int trial = 0; trial < trials; ++trial) {
+		float truth[7], pose[7], rms;
+		RandomPose(truth);
+		RandomVisibility(count, weights);
+		for(int i = 0; i < count; ++i) {
+			Move(truth, &points[3*i], &observed[3*i]);
+			for(int k = 0; k < 3; ++k) {
+				observed[3*i + k] += noise*Gaussian();
+			}
+		}
+		tClockTicks t0 = clock.ticks();
+		bool solved = solver.solve(&observed[0], &weights[0], pose, rms);
+		tClockTicks t1 = clock.ticks();
+		if(times != NULL) {
+			times->push_back(clock.elapsed(t0, t1));
+		}
+		if(!solved) {
+			++errors.failed;
+			continue;
+		}
+		float position, angle;
+		PoseError(truth, pose, position, angle);
+		errors.position += position;
+		errors.angle += angle;
+		errors.rms += rms;
+		errors.worstPosition = max(errors.worstPosition, position);
+		errors.worstAngle = max(errors.worstAngle, angle);
+	}
+	errors.position /= trials;
+	errors.angle /= trials;
+	errors.rms /= trials;
+	return errors;
+}
+
+int main(int argc, char** argv) {
+	int trials = argc > 1 ? atoi(argv[1]) : 20000;
+	if(trials < 100) {
+		cout << "rigid_solver_check: at least 100 solves\n";
+		return 1;
+	}
+	srand(1);
+	cout << "rigid_solver_check: " << trials << " solves per template, " << NOISE << " mm noise\n";
+	bool ok = true;
+	for(int t = 0; t < TEMPLATES; ++t) {
+		int count = TEMPLATE_MARKERS[t];
+		vector<float> points(3*count, 0.0f);
+		for(int i = 3; i < 3*count; ++i) {
+			points[i] = Random(-100.0f, 100.0f);
+		}
+
+		SErrors exact = Run(points, trials/10, 0.0f, NULL);
+		vector<double> times;
+		times.reserve(trials);
+		SErrors noisy = Run(points, trials, NOISE, &times);
+		sort(times.begin(), times.end());
+		double p50 = times[times.size()/2], p99 = times[times.size()*99/100];
+
+		bool good = exact.failed == 0 && exact.worstPosition <= 1.0e-3f && exact.worstAngle <= 0.01f
+			&& noisy.failed == 0 && noisy.position <= 1.0f && noisy.angle <= 1.0f
+			&& noisy.rms <= 2.0f*NOISE && p99 < SOLVE_LIMIT;
+		ok = ok && good;
+		cout << "   " << count << " markers: exact worst " << exact.worstPosition << " mm " << exact.worstAngle
+			<< " deg, noisy mean " << noisy.position << " mm " << noisy.angle << " deg rms " << noisy.rms
+			<< " mm, solve_us_p50 " << 1.0e6*p50 << ", solve_us_p99 " << 1.0e6*p99 << ", solve_us_max "
+			<< 1.0e6*times.back() << (good ? "\n" : "  FAILED\n");
+	}
+
+	//three markers in a line leave the turn about it free
+	cRigidSolver line;
+	float points[9] = {0.0f, 0.0f, 0.0f, 50.0f, 0.0f, 0.0f, 120.0f, 0.0f, 0.0f};
+	float observed[9], weights[3] = {1.0f, 1.0f, 1.0f}, truth[7], pose[7], rms;
+	line.setTemplate(points, 3);
+	RandomPose(truth);
+	for(int i = 0; i < 3; ++i) {
+		Move(truth, &points[3*i], &observed[3*i]);
+	}
+	bool refused = !line.solve(observed, weights, pose, rms);
+	ok = ok && refused;
+	cout << "   3 markers in a line: " << (refused ? "refused\n" : "solved  FAILED\n");
+
+	cout << (ok ? "rigid_solver_check: ok\n" : "rigid_solver_check: FAILED\n") << flush;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,180 @@
+//Stress test of the pose hand-off from the read thread to UpdateSensor (CPoseSeqlock.h).
+//
+//   seqlock_stress [seconds per part, default 3]
+//
+//1. The lock alone: one writer publishes as fast as it can while a reader on every
+//   other core reads as fast as it can. Every snapshot published has all its fields
+//   made from one counter, so a reader that finds two different values has a torn read.
+//2. The plugin against the synthetic source with ramp=1 (every coordinate is the frame
+//   number, scale 1): 24 OWL rigids and 56 point markers at 960 Hz, UpdateSensor called
+//   for every sensor back to back while busy threads load the other cores. With scale 1
+//   a pose from one frame has |x| = |y| = |z| (and the quaternion the same for rigids).
+//
+//Prints the reads, torn reads and poses seen per part; exits 1 if anything was torn.
+
+#include <math.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+
+#include "CPluginDriver.h"
+#include "CPoseSeqlock.h"
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+const int RIGIDS = 24;
+const int POINTS = 56;
+
+boost::atomic<bool> STOP(false);
+
+//--- part 1 -----------------------------------------------------------------
+
+void Writer(cPoseSeqlock* lock, unsigned long* published) {
+	SPoseSnapshot s;
+	memset(&s, 0, sizeof(s));
+	unsigned long n = 0;
+	while(!STOP) {
+		++n;
+		//floats hold every integer below 2^24 exactly
+		float v = float(n & 0xffffff);
+		for(int k = 0; k < 7; ++k) {
+			s.pose[k] = v;
+		}
+		s.samples = int(n & 0xffffff);
+		s.arrival = double(v);
+		lock->publish(s);
+	}
+	*published = n;
+}
+
+struct SReadCount {
+	unsigned long reads;
+	unsigned long torn;
+	unsigned long backwards;      //generation went down
+};
+
+void Reader(const cPoseSeqlock* lock, SReadCount* count) {
+	SPoseSnapshot s;
+	unsigned int last = 0;
+	while(!STOP) {
+		unsigned int generation = lock->read(s);
+		++count->reads;
+		bool same = float(s.samples) == s.pose[0] && s.arrival == double(s.pose[0]);
+		for(int k = 1; k < 7; ++k) {
+			same = same && s.pose[k] == s.pose[0];
+		}
+		if(!same) {
+			++count->torn;
+		}
+		if(generation < last) {
+			++count->backwards;
+		}
+		last = generation;
+	}
+}
+
+bool LockAlone(const double& seconds, const int& readers) {
+	cPoseSeqlock lock;
+	unsigned long published = 0;
+	vector<SReadCount> counts(readers);
+	memset(&counts[0], 0, readers*sizeof(SReadCount));
+	STOP = false;
+	boost::thread_group threads;
+	threads.create_thread(boost::bind(Writer, &lock, &published));
+	for(int i = 0; i < readers; ++i) {
+		threads.create_thread(boost::bind(Reader, &lock, &counts[i]));
+	}
+	cPluginDriver::sleep(seconds);
+	STOP = true;
+	threads.join_all();
+
+	SReadCount total = {0, 0, 0};
+	for(int i = 0; i < readers; ++i) {
+		total.reads += counts[i].reads;
+		total.torn += counts[i].torn;
+		total.backwards += counts[i].backwards;
+	}
+	cout << "seqlock alone: " << published << " publishes, " << readers << " readers, " << total.reads
+		<< " reads, " << total.torn << " torn, " << total.backwards << " out of order\n" << flush;
+	return total.torn == 0 && total.backwards == 0 && total.reads > 0;
+}
+
+//--- part 2 -----------------------------------------------------------------
+
+void Busy() {
+	volatile double x = 1.0;
+	while(!STOP) {
+		x = sqrt(x + 1.0);
+	}
+}
+
+bool Plugin(const double& seconds, const int& load) {
+	cPluginDriver plugin;
+	int marker = 0;
+	for(int i = 0; i < RIGIDS + POINTS; ++i) {
+		int id = plugin.add();
+		int markers = i < RIGIDS ? 3 : 1;
+		for(int m = 0; m < markers; ++m) {
+			plugin.command(id, 5, float(marker++));
+		}
+		plugin.command(id, i < RIGIDS ? 6 : 7);
+	}
+	plugin.command(0, 2, 1.0f, 1.0f, 1.0f);
+	plugin.command(0, 3, 0.0f, 0.0f, 0.0f);
+	if(!plugin.start("sim:hz=960,ramp=1")) {
+		cout << "plugin: the synthetic server did not start\n" << flush;
+		plugin.close();
+		return false;
+	}
+
+	STOP = false;
+	boost::thread_group busy;
+	for(int i = 0; i < load; ++i) {
+		busy.create_thread(Busy);
+	}
+	cPrecisionClock clock;
+	unsigned long reads = 0, torn = 0, moved = 0;
+	vector<float> last(plugin.size(), 0.0f);
+	double end = clock.getCPUTimeSeconds() + seconds;
+	while(clock.getCPUTimeSeconds() < end) {
+		for(int id = 0; id < plugin.size(); ++id) {
+			plugin.update(id);
+			const float* d = plugin.data(id);
+			int fields = id < RIGIDS ? 7 : 3;
+			bool same = true;
+			for(int k = 1; k < fields; ++k) {
+				same = same && fabs(d[k]) == fabs(d[0]);
+			}
+			if(!same) {
+				++torn;
+			}
+			if(d[0] != last[id]) {
+				++moved;
+				last[id] = d[0];
+			}
+			++reads;
+		}
+	}
+	STOP = true;
+	busy.join_all();
+	plugin.close();
+
+	cout << "plugin: " << plugin.size() << " sensors, " << load << " busy threads, " << reads << " reads, "
+		<< torn << " torn, " << moved << " new poses seen\n" << flush;
+	return torn == 0 && moved > 0;
+}
+
+int main(int argc, char** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+	int cores = int(boost::thread::hardware_concurrency());
+	if(cores < 2) {
+		cores = 2;
+	}
+	bool ok = LockAlone(seconds, cores - 1);
+	ok = Plugin(seconds, cores - 1) && ok;
+	cout << (ok ? "seqlock_stress: ok\n" : "seqlock_stress: FAILED\n") << flush;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+//The OWL -> Vizard pose transform (CPoseTransform.h) against the per-sensor mapping it
+//replaced, then the time per frame of each.
+//
+//   transform_check [frames to time, default 100000]
+//
+//1. The kernel against the old code: a random global scale and offset through
+//   defaultCalibration for 1 to 131 slots (so the AVX, SSE and scalar remainders are
+//   all used) must give what the per-sensor loop of threadMe/UpdateSensor gave
+//   (BaselineFrame below, a copy of it), at every lane width.
+//2. The lane widths against each other: random calibrations (rotation, scale, offset,
+//   with the PhaseSpace x mirror), apply(8) and apply(4) must match apply(1).
+//Both to rounding: 1e-5 between widths (the compiler may fuse multiply-adds), 1e-4
+//against the old code, which adds the offset before scaling and so rounds a few float
+//steps of the larger term differently. Then 16 and 128 sensors are timed with the old loop and each width.
+//Build with the SIMD flags of the plugin (the Makefile uses SIMD_FLAGS) to check those.
+//Exits 1 on a mismatch.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include "CPoseTransform.h"
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+float Random(const float& low, const float& high) {
+	return low + (high - low)*float(rand())/float(RAND_MAX);
+}
+
+//a calibration with a proper rotation about a random axis, scaled, with the x mirror
+void RandomCalibration(float m[12]) {
+	float axis[3] = {Random(-1, 1), Random(-1, 1), Random(-1, 1)};
+	float n = sqrtf(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]) + 1.0e-6f;
+	float angle = Random(-3.1f, 3.1f);
+	float w = cosf(0.5f*angle), s = sinf(0.5f*angle)/n;
+	float x = axis[0]*s, y = axis[1]*s, z = axis[2]*s;
+	float r[3][3] = {
+		{1 - 2*(y*y + z*z), 2*(x*y - w*z), 2*(x*z + w*y)},
+		{2*(x*y + w*z), 1 - 2*(x*x + z*z), 2*(y*z - w*x)},
+		{2*(x*z - w*y), 2*(y*z + w*x), 1 - 2*(x*x + y*y)}};
+	float scale = Random(0.0005f, 2.0f);
+	for(int row = 0; row < 3; ++row) {
+		m[4*row + 0] = -scale*r[row][0];
+		m[4*row + 1] = scale*r[row][1];
+		m[4*row + 2] = scale*r[row][2];
+		m[4*row + 3] = Random(-1000, 1000);
+	}
+}
+
+void RandomPose(float pose[7]) {
+	for(int k = 0; k < 3; ++k) {
+		pose[k] = Random(-3000, 3000);
+	}
+	float n = 0.0f;
+	for(int k = 3; k < 7; ++k) {
+		pose[k] = Random(-1, 1);
+		n += pose[k]*pose[k];
+	}
+	n = sqrtf(n) + 1.0e-6f;
+	for(int k = 3; k < 7; ++k) {
+		pose[k] /= n;
+	}
+}
+
+//a sensor as the old read loop kept it: the last good OWL pose, mapped every frame
+struct SBaselineSensor {
+	bool isRigid;
+	float lastGood[7];
+	float data[7];
+};
+
+//The per-sensor mapping from before CPoseTransform.h (UpdateSensor of the original
+//plugin, the same numbers threadMe recorded), with the global scale and offset.
+void BaselineFrame(vector<SBaselineSensor>& sensors, const float scale[3], const float offset[3]) {
+	for(int i = 0; i < sensors.size(); ++i) {
+		SBaselineSensor& s = sensors[i];
+		s.data[0] = -1.0f * scale[0] * ( s.lastGood[0] + offset[0] );
+		s.data[1] = scale[1] * ( s.lastGood[1] + offset[1] );
+		s.data[2] = scale[2] * ( s.lastGood[2] + offset[2] );
+		if(s.isRigid) {
+			s.data[3] = -1.0f * s.lastGood[4];
+			s.data[4] = s.lastGood[5];
+			s.data[5] = s.lastGood[6];
+			s.data[6] = -1.0f * s.lastGood[3];
+		} else {
+			s.data[3] = 0.0f;
+			s.data[4] = 0.0f;
+			s.data[5] = 0.0f;
+			s.data[6] = 1.0f;
+		}
+	}
+}
+
+//random global scale and offset, and a batch and old sensors with the same random rigids
+void RandomFrame(const int& count, float scale[3], float offset[3], cPoseTransformBatch& batch,
+	vector<SBaselineSensor>& sensors) {
+	for(int k = 0; k < 3; ++k) {
+		scale[k] = Random(0.0005f, 2.0f);
+		offset[k] = Random(-1000, 1000);
+	}
+	float m[12];
+	cPoseTransformBatch::defaultCalibration(m, scale, offset);
+	batch.resize(count);
+	sensors.resize(count);
+	for(int i = 0; i < count; ++i) {
+		batch.setCalibration(i, m);
+		RandomPose(sensors[i].lastGood);
+		sensors[i].isRigid = true;
+		batch.setInput(i, sensors[i].lastGood);
+	}
+}
+
+//largest difference from the reference, relative to its size
+float Compare(cPoseTransformBatch& batch, const int& width, const float* reference) {
+	batch.apply(width);
+	float worst = 0.0f;
+	for(int i = 0; i < batch.size(); ++i) {
+		float out[7];
+		batch.getOutput(i, out);
+		for(int k = 0; k < 7; ++k) {
+			float difference = fabsf(out[k] - reference[7*i + k])/(1.0f + fabsf(reference[7*i + k]));
+			if(difference > worst) {
+				worst = difference;
+			}
+		}
+	}
+	return worst;
+}
+
+double TimeBaseline(vector<SBaselineSensor>& sensors, const float scale[3], const float offset[3], const int& frames) {
+	cPrecisionClock clock;
+	tClockTicks start = clock.ticks();
+	for(int f = 0; f < frames; ++f) {
+		BaselineFrame(sensors, scale, offset);
+	}
+	return clock.elapsed(start, clock.ticks())/double(frames);
+}
+
+double TimeFrame(cPoseTransformBatch& batch, const int& width, const int& frames) {
+	cPrecisionClock clock;
+	tClockTicks start = clock.ticks();
+	for(int f = 0; f < frames; ++f) {
+		batch.apply(width);
+	}
+	return clock.elapsed(start, clock.ticks())/double(frames);
+}
+
+int main(int argc, char** argv) {
+	int frames = argc > 1 ? atoi(argv[1]) : 100000;
+	const int widths[3] = {8, 4, 1};
+	cout << "transform_check: widest lanes " << cPoseTransformBatch::laneWidth() << "\n";
+
+	float old[3] = {0.0f, 0.0f, 0.0f};
+	srand(1);
+	for(int count = 1; count <= 131; ++count) {
+		float scale[3], offset[3];
+		cPoseTransformBatch batch;
+		vector<SBaselineSensor> sensors;
+		RandomFrame(count, scale, offset, batch, sensors);
+		BaselineFrame(sensors, scale, offset);
+		vector<float> reference(7*count);
+		for(int i = 0; i < count; ++i) {
+			memcpy(&reference[7*i], sensors[i].data, sizeof(sensors[i].data));
+		}
+		for(int w = 0; w < 3; ++w) {
+			float difference = Compare(batch, widths[w], &reference[0]);
+			if(difference > old[w]) {
+				old[w] = difference;
+			}
+		}
+	}
+	bool ok = old[0] <= 1.0e-4f && old[1] <= 1.0e-4f && old[2] <= 1.0e-4f;
+	cout << "   largest difference from the old per-sensor code: width 8 " << old[0] << ", width 4 " << old[1]
+		<< ", width 1 " << old[2] << "\n";
+
+	float worst[2] = {0.0f, 0.0f};
+	for(int count = 1; count <= 131; ++count) {
+		cPoseTransformBatch batch;
+		batch.resize(count);
+		for(int i = 0; i < count; ++i) {
+			float m[12], pose[7];
+			RandomCalibration(m);
+			batch.setCalibration(i, m);
+			RandomPose(pose);
+			batch.setInput(i, pose);
+		}
+		float* reference = new float[7*count];
+		batch.apply(1);
+		for(int i = 0; i < count; ++i) {
+			batch.getOutput(i, reference + 7*i);
+		}
+		for(int w = 0; w < 2; ++w) {
+			float difference = Compare(batch, widths[w], reference);
+			if(difference > worst[w]) {
+				worst[w] = difference;
+			}
+		}
+		delete[] reference;
+	}
+	ok = ok && worst[0] <= 1.0e-5f && worst[1] <= 1.0e-5f;
+	cout << "   largest difference from scalar: width 8 " << worst[0] << ", width 4 " << worst[1] << "\n";
+
+	const int slots[2] = {16, 128};
+	for(int c = 0; c < 2; ++c) {
+		float scale[3], offset[3];
+		cPoseTransformBatch batch;
+		vector<SBaselineSensor> sensors;
+		RandomFrame(slots[c], scale, offset, batch, sensors);
+		double baseline = TimeBaseline(sensors, scale, offset, frames);
+		cout << "   " << slots[c] << " sensors: old loop " << 1.0e9*baseline << " ns,";
+		for(int w = 0; w < 3; ++w) {
+			double t = TimeFrame(batch, widths[w], frames);
+			cout << " width " << min(widths[w], cPoseTransformBatch::laneWidth()) << " " << 1.0e9*t << " ns"
+				<< " (x" << baseline/t << ")" << (w < 2 ? "," : "\n");
+		}
+	}
+	cout << (ok ? "transform_check: ok\n" : "transform_check: FAILED\n") << flush;
+	return ok ? 0 : 1;
+}
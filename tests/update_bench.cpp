@@ -0,0 +1,87 @@
+//Render frame cost of the Vizard side (UpdateSensor) for a number of sensors.
+//
+//   update_bench <sensors, 1 to 128> [render frames, default 300]
+//
+//Point marker sensors against the synthetic source at 960 Hz with ramp=1, and a 90 Hz
+//render loop, so every render frame finds new poses to copy. Frames alternate between
+//the way Vizard calls the plugin, UpdateSensor once for every sensor, and one
+//UpdateAllSensors call, and each frame's calls are timed together. The plugin's state
+//is global, so each sensor count is a separate run (see check in the Makefile).
+//Exits 1 if the source did not start or a sensor never got a pose.
+
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include "CPluginDriver.h"
+#include "CPrecisionClock.h"
+
+using namespace std;
+
+const double RENDER_PERIOD = 1.0/90.0;
+
+//median and largest, in us
+void Print(const char* name, vector<double>& times) {
+	sort(times.begin(), times.end());
+	cout << "   " << name << ": p50 " << 1.0e6*times[times.size()/2] << " us, max "
+		<< 1.0e6*times.back() << " us\n";
+}
+
+int main(int argc, char** argv) {
+	int sensors = argc > 1 ? atoi(argv[1]) : 16;
+	int frames = argc > 2 ? atoi(argv[2]) : 300;
+	if(sensors < 1 || sensors > 128 || frames < 2) {
+		cout << "update_bench: 1 to 128 sensors, at least 2 frames\n";
+		return 1;
+	}
+	cPluginDriver plugin;
+	for(int i = 0; i < sensors; ++i) {
+		int id = plugin.add();
+		plugin.command(id, 5, float(i));
+		plugin.command(id, 7);
+	}
+	if(!plugin.start("sim:hz=960,ramp=1")) {
+		cout << "update_bench: the synthetic server did not start\n";
+		plugin.close();
+		return 1;
+	}
+	plugin.sleep(0.1);
+
+	cPrecisionClock clock;
+	vector<double> each, all;
+	double start = clock.getCPUTimeSeconds();
+	for(int frame = 1; frame <= frames; ++frame) {
+		tClockTicks t0 = clock.ticks();
+		if(frame % 2 == 1) {
+			for(int id = 0; id < plugin.size(); ++id) {
+				plugin.update(id);
+			}
+			each.push_back(clock.elapsed(t0, clock.ticks()));
+		} else {
+			UpdateAllSensors();
+			all.push_back(clock.elapsed(t0, clock.ticks()));
+		}
+		double next = start + frame*RENDER_PERIOD - clock.getCPUTimeSeconds();
+		if(next > 0.0) {
+			plugin.sleep(next);
+		}
+	}
+	plugin.close();
+
+	//ramp=1 makes every coordinate the frame number, 0 only before the first frame
+	int empty = 0;
+	for(int id = 0; id < plugin.size(); ++id) {
+		if(plugin.data(id)[0] == 0.0f) {
+			++empty;
+		}
+	}
+	cout << "update_bench: " << sensors << " sensors, " << frames << " render frames\n";
+	Print("UpdateSensor for each sensor", each);
+	Print("UpdateAllSensors", all);
+	if(empty > 0) {
+		cout << "update_bench: " << empty << " sensors without a pose\n";
+	}
+	cout << flush;
+	return empty == 0 ? 0 : 1;
+}